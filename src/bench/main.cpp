@@ -0,0 +1,380 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+
+#include "thorin/be/codegen.h"
+
+#include "impala/args.h"
+#include "impala/ast.h"
+#include "impala/impala.h"
+#include "impala/lexer.h"
+
+// Measures the throughput of each phase of the compiler in-process.
+// Inputs are the given files and directories (searched for *.impala) plus synthetic programs
+// of growing size; for the latter the growth of each phase is fitted as time ~ size^exponent.
+// It also reports the heap bytes the AST of each input holds after parsing and the Defs emission creates.
+
+typedef std::vector<std::string> Names;
+
+/*
+ * heap accounting - each allocation is prefixed with its size so that deallocations can be subtracted
+ */
+
+static size_t live_bytes = 0;
+
+void* operator new(std::size_t size) {
+    auto p = static_cast<std::size_t*>(std::malloc(size + alignof(std::max_align_t)));
+    if (p == nullptr)
+        throw std::bad_alloc();
+    *p = size;
+    live_bytes += size;
+    return reinterpret_cast<char*>(p) + alignof(std::max_align_t);
+}
+
+void operator delete(void* p) noexcept {
+    if (p == nullptr) return;
+    auto base = static_cast<char*>(p) - alignof(std::max_align_t);
+    live_bytes -= *reinterpret_cast<std::size_t*>(base);
+    std::free(base);
+}
+
+void operator delete(void* p, std::size_t) noexcept { operator delete(p); }
+
+// EmitNames repeats Emit with EmitOptions::names for comparison and does not count towards the total
+enum Phase { Lex, Parse, NameSema, InferSema, TypeSema, Emit, Cleanup, Opt, EmitNames, Num_Phases };
+
+static const char* phase_names[Num_Phases] = { "lex", "parse", "namesema", "infersema", "typesema", "emit", "cleanup", "opt", "emit_names" };
+
+struct Sample {
+    std::string name;
+    std::string kind; ///< "corpus" or the generator
+    size_t size = 0;  ///< scale factor of synthetic inputs
+    size_t bytes = 0;
+    size_t tokens = 0;
+    size_t nodes = 0; ///< AST nodes created by the parser
+    size_t ast_bytes = 0; ///< heap bytes held by the AST after parsing
+    size_t defs = 0; ///< Defs in the Thorin world right after emission
+    size_t continuations = 0; ///< continuations among them
+    bool errors = false;
+    double times[Num_Phases] = {}; ///< best of all repetitions in seconds
+};
+
+//------------------------------------------------------------------------------
+
+/*
+ * synthetic programs
+ */
+
+// ((((x + 1) * 3) + 1) * 3) ... with 64 * n levels
+static std::string gen_nesting(size_t n) {
+    std::ostringstream o;
+    size_t depth = 64 * n;
+    o << "fn nested(x: i32) -> i32 {\n    ";
+    for (size_t i = 0; i != depth; ++i) o << '(';
+    o << 'x';
+    for (size_t i = 0; i != depth; ++i) o << (i % 2 == 0 ? " + 1)" : " * 3)");
+    o << "\n}\n\nfn main() -> i32 { nested(0) }\n";
+    return o.str();
+}
+
+// 64 * n call sites of generic functions and structs at varying types
+static std::string gen_generics(size_t n) {
+    static const char* types[] = { "i8", "i16", "i32", "i64", "u8", "u16", "u32", "u64", "f32", "f64", "bool" };
+    std::ostringstream o;
+    o << "struct Box[T] { v: T }\n\n"
+      << "fn unbox[T](b: Box[T]) -> T { b.v }\n"
+      << "fn pick[T](c: bool, a: T, b: T) -> T { if c { a } else { b } }\n\n";
+    for (size_t i = 0, e = 64 * n; i != e; ++i) {
+        auto t = types[i % 11];
+        auto v = std::string(t) == "bool" ? "true" : "0 as " + std::string(t);
+        o << "fn inst" << i << "(c: bool) -> " << t << " { pick[" << t << "](c, unbox[" << t << "](Box[" << t << "] { v: " << v << " }), " << v << ") }\n";
+    }
+    o << "\nfn main() -> i32 { inst2(true) }\n";
+    return o.str();
+}
+
+// a single match with 256 * n arms
+static std::string gen_match(size_t n) {
+    std::ostringstream o;
+    o << "fn select(x: i32) -> i32 {\n    match x {\n";
+    for (size_t i = 0, e = 256 * n; i != e; ++i)
+        o << "        " << i << " => " << (i * 7 % 13) << ",\n";
+    o << "        _ => -1,\n    }\n}\n\nfn main() -> i32 { select(42) }\n";
+    return o.str();
+}
+
+// 64 * n functions with loops, each calling its predecessor
+static std::string gen_long(size_t n) {
+    std::ostringstream o;
+    o << "fn f0(x: i32) -> i32 { x }\n";
+    for (size_t i = 1, e = 64 * n; i != e; ++i) {
+        o << "fn f" << i << "(x: i32) -> i32 {\n"
+          << "    let mut s = 0;\n"
+          << "    let mut i = 0;\n"
+          << "    while i < x {\n"
+          << "        if i % 3 == 0 { s += f" << i - 1 << "(i); } else { s -= i; }\n"
+          << "        i++;\n"
+          << "    }\n"
+          << "    s\n"
+          << "}\n";
+    }
+    o << "\nfn main() -> i32 { f" << 64 * n - 1 << "(3) }\n";
+    return o.str();
+}
+
+static const std::pair<const char*, std::string (*)(size_t)> generators[] = {
+    { "nesting",  gen_nesting  },
+    { "generics", gen_generics },
+    { "match",    gen_match    },
+    { "long",     gen_long     },
+};
+
+//------------------------------------------------------------------------------
+
+template<class F>
+static double seconds(F f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/// Parses @p src and runs semantic analysis without timing it.
+static std::unique_ptr<const impala::Module> check(const std::string& name, const std::string& src, std::unique_ptr<impala::TypeTable>& typetable) {
+    impala::Items items;
+    std::istringstream is(src);
+    impala::parse(items, is, name.c_str());
+    auto module = std::make_unique<const impala::Module>(name.c_str(), std::move(items));
+    impala::check(typetable, module.get());
+    return module;
+}
+
+/// Runs all phases on @p src once; a phase is skipped if an earlier one reported errors.
+static void run(Sample& sample, const std::string& src, bool first, bool parse_only, bool names) {
+    impala::num_warnings() = 0;
+    impala::num_errors()   = 0;
+
+    double t[Num_Phases] = {};
+    auto filename = sample.name.c_str();
+
+    size_t tokens = 0;
+    t[Lex] = seconds([&] {
+        std::istringstream is(src);
+        impala::Lexer lexer(is, filename);
+        while (lexer.lex().tag() != impala::Token::Eof)
+            ++tokens;
+    });
+
+    impala::Items items;
+    auto num_nodes = impala::ASTNode::num_nodes();
+    auto num_bytes = live_bytes;
+    t[Parse] = seconds([&] {
+        std::istringstream is(src);
+        impala::parse(items, is, filename);
+    });
+    sample.nodes = impala::ASTNode::num_nodes() - num_nodes;
+    sample.ast_bytes = live_bytes - num_bytes;
+    auto module = std::make_unique<const impala::Module>(filename, std::move(items));
+
+    std::unique_ptr<impala::TypeTable> typetable;
+    auto ok = [&] { return impala::num_errors() == 0 && !parse_only; };
+    if (ok()) t[NameSema]  = seconds([&] { impala::name_analysis(module.get()); });
+    if (ok()) t[InferSema] = seconds([&] { impala::type_inference(typetable, module.get()); });
+    if (ok()) t[TypeSema]  = seconds([&] { impala::type_analysis(module.get()); });
+
+    if (ok()) {
+        impala::EmitOptions opts;
+        opts.names = false;
+        thorin::Thorin thorin(sample.name);
+        t[Emit]    = seconds([&] { impala::emit(thorin.world(), module.get(), opts); });
+        sample.defs = thorin.world().defs().size();
+        sample.continuations = thorin.world().copy_continuations().size();
+        t[Cleanup] = seconds([&] { thorin.cleanup(); });
+        t[Opt]     = seconds([&] { thorin.opt(); });
+    }
+
+    // emission annotates the AST, so the variant with names needs a module of its own
+    if (ok() && names) {
+        std::unique_ptr<impala::TypeTable> named_typetable;
+        auto named_module = check(sample.name, src, named_typetable);
+        thorin::Thorin thorin(sample.name);
+        t[EmitNames] = seconds([&] { impala::emit(thorin.world(), named_module.get()); });
+    }
+
+    sample.tokens = tokens;
+    sample.errors = impala::num_errors() != 0;
+    for (int i = 0; i != Num_Phases; ++i)
+        sample.times[i] = first ? t[i] : std::min(sample.times[i], t[i]);
+}
+
+static Sample measure(const std::string& name, const std::string& kind, size_t size, const std::string& src, int repeat, bool parse_only, bool names) {
+    Sample sample;
+    sample.name  = name;
+    sample.kind  = kind;
+    sample.size  = size;
+    sample.bytes = src.size();
+    for (int i = 0; i != repeat; ++i)
+        run(sample, src, i == 0, parse_only, names);
+    return sample;
+}
+
+/// Least-squares slope of log(time) over log(bytes); 1 is linear.
+static double exponent(const std::vector<const Sample*>& samples, int phase) {
+    double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (auto s : samples) {
+        if (s->times[phase] <= 0) continue;
+        double x = std::log(double(s->bytes)), y = std::log(s->times[phase]);
+        n += 1; sx += x; sy += y; sxx += x*x; sxy += x*y;
+    }
+    double d = n*sxx - sx*sx;
+    return n < 2 || d == 0 ? 0 : (n*sxy - sx*sy) / d;
+}
+
+//------------------------------------------------------------------------------
+
+static std::string json_string(const std::string& str) {
+    std::string result = "\"";
+    for (auto c : str) {
+        if (c == '"' || c == '\\') result += '\\';
+        if (c == '\n') { result += "\\n"; continue; }
+        result += c;
+    }
+    return result + "\"";
+}
+
+static void write_json(std::ostream& o, const std::vector<Sample>& samples, const Names& kinds, double threshold) {
+    o << "{\n  \"samples\": [";
+    const char* sep = "\n";
+    for (auto& s : samples) {
+        o << sep << "    { \"name\": " << json_string(s.name) << ", \"kind\": " << json_string(s.kind)
+          << ", \"size\": " << s.size << ", \"bytes\": " << s.bytes << ", \"tokens\": " << s.tokens << ", \"nodes\": " << s.nodes
+          << ", \"ast_bytes\": " << s.ast_bytes << ", \"defs\": " << s.defs << ", \"continuations\": " << s.continuations
+          << ", \"errors\": " << (s.errors ? "true" : "false") << ", \"seconds\": {";
+        double total = 0;
+        for (int i = 0; i != Num_Phases; ++i) {
+            o << (i == 0 ? " " : ", ") << json_string(phase_names[i]) << ": " << s.times[i];
+            if (i != EmitNames)
+                total += s.times[i];
+        }
+        o << " }, \"bytes_per_second\": " << (total > 0 ? s.bytes / total : 0)
+          << ", \"names_speedup\": " << (s.times[Emit] > 0 ? s.times[EmitNames] / s.times[Emit] : 0)
+          << ", \"parsed_nodes_per_second\": " << (s.times[Parse] > 0 ? s.nodes / s.times[Parse] : 0) << " }";
+        sep = ",\n";
+    }
+    o << "\n  ],\n  \"scaling\": {";
+
+    sep = "\n";
+    for (auto& kind : kinds) {
+        std::vector<const Sample*> series;
+        for (auto& s : samples)
+            if (s.kind == kind) series.push_back(&s);
+
+        o << sep << "    " << json_string(kind) << ": { \"exponents\": {";
+        std::string superlinear;
+        for (int i = 0; i != Num_Phases; ++i) {
+            auto e = exponent(series, i);
+            o << (i == 0 ? " " : ", ") << json_string(phase_names[i]) << ": " << e;
+            if (e > threshold)
+                superlinear += (superlinear.empty() ? "" : ", ") + json_string(phase_names[i]);
+        }
+        o << " }, \"superlinear\": [" << superlinear << "] }";
+        sep = ",\n";
+    }
+    o << "\n  }\n}\n";
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+    try {
+        Names inputs, synthetic, sizes;
+        std::string out_name, threshold;
+        int repeat;
+        bool help, parse_only, names;
+
+        auto cmd_parser = impala::ArgParser()
+            .implicit_option       (             "<inputs>", "files or directories searched for *.impala files", inputs)
+            .add_option<bool>       ("help",      "",         "produce this help message", help, false)
+            .add_option<Names>      ("synthetic", "<kinds>",  "synthetic inputs to generate: nesting, generics, match, long", synthetic)
+            .add_option<Names>      ("sizes",     "<args>",   "scale factors of the synthetic inputs", sizes, {"1", "2", "4", "8", "16"})
+            .add_option<int>        ("repeat",    "<arg>",    "measure each input this many times and keep the fastest", repeat, 3)
+            .add_option<bool>       ("parse-only", "",        "only lex and parse, e.g. for large synthetic inputs", parse_only, false)
+            .add_option<bool>       ("names",     "",         "also time emission with names attached to the Thorin program as emit_names and report emit_names / emit as names_speedup", names, false)
+            .add_option<std::string>("threshold", "<arg>",    "report phases whose fitted exponent exceeds this as superlinear", threshold, "1.3")
+            .add_option<std::string>("o",         "<arg>",    "write the JSON report to this file instead of stdout", out_name, "");
+        cmd_parser.parse(argc, argv);
+
+        if (help) {
+            cmd_parser.print_help();
+            return EXIT_SUCCESS;
+        }
+
+        for (auto& kind : synthetic) {
+            if (std::none_of(std::begin(generators), std::end(generators), [&] (auto& g) { return kind == g.first; }))
+                throw std::invalid_argument("unknown synthetic input '" + kind + "'");
+        }
+
+        impala::init();
+
+        // diagnostics of negative tests in the corpus are expected
+        std::ostringstream diagnostics;
+        auto old_cerr = std::cerr.rdbuf(diagnostics.rdbuf());
+
+        std::vector<std::string> files;
+        for (auto& input : inputs) {
+            if (std::filesystem::is_directory(input)) {
+                for (auto& entry : std::filesystem::recursive_directory_iterator(input)) {
+                    if (entry.is_regular_file() && entry.path().extension() == ".impala")
+                        files.push_back(entry.path().string());
+                }
+            } else {
+                files.push_back(input);
+            }
+        }
+        std::sort(files.begin(), files.end());
+
+        std::vector<Sample> samples;
+        for (auto& file : files) {
+            std::ifstream is(file);
+            if (!is)
+                throw std::runtime_error("cannot read '" + file + "'");
+            std::stringstream src;
+            src << is.rdbuf();
+            samples.push_back(measure(file, "corpus", 1, src.str(), repeat, parse_only, names));
+        }
+
+        for (auto& g : generators) {
+            if (std::find(synthetic.begin(), synthetic.end(), g.first) == synthetic.end())
+                continue;
+            for (auto& size : sizes) {
+                auto n = std::stoul(size);
+                samples.push_back(measure(std::string(g.first) + "_" + size + ".impala", g.first, n, g.second(n), repeat, parse_only, names));
+            }
+        }
+
+        std::cerr.rdbuf(old_cerr);
+
+        std::ofstream out_file;
+        if (!out_name.empty()) {
+            out_file.open(out_name);
+            if (!out_file)
+                throw std::runtime_error("cannot write '" + out_name + "'");
+        }
+        write_json(out_name.empty() ? std::cout : out_file, samples, synthetic, std::stod(threshold));
+    } catch (std::exception const& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    } catch (...) {
+        std::cerr << "unknown exception" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -51,6 +51,51 @@ const Expr* Expr::skip_rvalue() const {
     return this;
 }
 
+bool MapExpr::is_soa_access() const {
+    return soa_struct_type(unpack_ref_type(lhs()->type())) != nullptr;
+}
+
+Intrinsic MapExpr::intrinsic() const {
+    auto callee = lhs();
+    if (auto type_app_expr = callee->isa<TypeAppExpr>())
+        callee = type_app_expr->lhs();
+    if (auto path_expr = callee->skip_rvalue()->isa<PathExpr>()) {
+        if (auto value_decl = path_expr->value_decl()) {
+            if (auto fn_decl = value_decl->isa<FnDecl>())
+                return fn_decl->intrinsic();
+        }
+    }
+    return Intrinsic::None;
+}
+
+const FnDecl* ForExpr::builtin_range() const {
+    if (fn_expr()->filter() || fn_expr()->num_params() != 2)
+        return nullptr;
+    for (auto&& param : fn_expr()->params()) {
+        if (param->filter())
+            return nullptr;
+    }
+
+    if (auto path_expr = expr()->as<MapExpr>()->lhs()->skip_rvalue()->isa<PathExpr>()) {
+        if (auto value_decl = path_expr->value_decl()) {
+            auto fn_decl = value_decl->isa<FnDecl>();
+            if (fn_decl && fn_decl->is_builtin_range())
+                return fn_decl;
+        }
+    }
+    return nullptr;
+}
+
+bool FnDecl::is_inline() const {
+    if (!ast_type_params().empty() || filter())
+        return true;
+    for (auto&& param : params()) {
+        if (param->filter() || (param->symbol() != "return" && param->ast_type() && param->ast_type()->isa<FnASTType>()))
+            return true;
+    }
+    return false;
+}
+
 uint64_t LiteralExpr::get_u64() const { return thorin::bitcast<uint64_t, thorin::Box>(box()); }
 
 bool IfExpr::has_else() const {
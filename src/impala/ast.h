@@ -8,6 +8,8 @@
 #include "thorin/util/types.h"
 
 #include "impala/impala.h"
+#include "impala/intrinsic.h"
+#include "impala/slots.h"
 #include "impala/token.h"
 #include "impala/sema/type.h"
 
@@ -42,8 +44,8 @@ class TypeSema;
 class CodeGen;
 
 typedef ArrayRef<std::unique_ptr<const ASTType>> ASTTypeArgs;
-typedef std::deque<std::unique_ptr<const Expr>> Exprs;
-typedef std::deque<std::unique_ptr<const Ptrn>> Ptrns;
+typedef Slots<const Expr> Exprs;
+typedef Slots<const Ptrn> Ptrns;
 typedef std::vector<Symbol> Symbols;
 typedef std::vector<const LocalDecl*> LocalDecls;
 typedef std::vector<std::string> Strings;
@@ -141,6 +143,9 @@ public:
     Loc loc() const { return loc_; }
     virtual Stream& stream(Stream&) const = 0;
 
+    /// Number of @p ASTNode%s created so far.
+    static size_t num_nodes() { return gid_counter_ - 1; }
+
 private:
     static size_t gid_counter_;
 
@@ -213,7 +218,7 @@ public:
         friend class InferSema;
     };
 
-    typedef std::deque<std::unique_ptr<const Elem>> Elems;
+    typedef Slots<const Elem> Elems;
 
     Path(Loc loc, bool global, Elems&& elems)
         : Typeable(loc)
@@ -360,12 +365,13 @@ private:
 
 class DefiniteArrayASTType : public ArrayASTType {
 public:
-    DefiniteArrayASTType(Loc loc, const ASTType* elem_ast_type, uint64_t dim)
+    DefiniteArrayASTType(Loc loc, const ASTType* elem_ast_type, const ASTType* dim_ast_type)
         : ArrayASTType(loc, elem_ast_type)
-        , dim_(dim)
+        , dim_ast_type_(dim_ast_type)
     {}
 
-    uint64_t dim() const { return dim_; }
+    /// A @p DimASTType or an @p ASTTypeApp naming a @c const type parameter.
+    const ASTType* dim_ast_type() const { return dim_ast_type_.get(); }
 
     void bind(NameSema&) const override;
     Stream& stream(Stream&) const override;
@@ -374,7 +380,27 @@ private:
     const Type* infer(InferSema&) const override;
     void check(TypeSema&) const override;
 
-    uint64_t dim_;
+    std::unique_ptr<const ASTType> dim_ast_type_;
+};
+
+/// Integer literal as dimension of an array or simd type or as argument of a @c const type parameter.
+class DimASTType : public ASTType {
+public:
+    DimASTType(Loc loc, uint64_t value)
+        : ASTType(loc)
+        , value_(value)
+    {}
+
+    uint64_t value() const { return value_; }
+
+    void bind(NameSema&) const override;
+    Stream& stream(Stream&) const override;
+
+private:
+    const Type* infer(InferSema&) const override;
+    void check(TypeSema&) const override;
+
+    uint64_t value_;
 };
 
 class CompoundASTType : public ASTType {
@@ -476,12 +502,13 @@ private:
 
 class SimdASTType : public ArrayASTType {
 public:
-    SimdASTType(Loc loc, const ASTType* elem_ast_type, uint64_t size)
+    SimdASTType(Loc loc, const ASTType* elem_ast_type, const ASTType* dim_ast_type)
         : ArrayASTType(loc, elem_ast_type)
-        , size_(size)
+        , dim_ast_type_(dim_ast_type)
     {}
 
-    uint64_t size() const { return size_; }
+    /// A @p DimASTType or an @p ASTTypeApp naming a @c const type parameter.
+    const ASTType* dim_ast_type() const { return dim_ast_type_.get(); }
 
     void bind(NameSema&) const override;
     Stream& stream(Stream&) const override;
@@ -490,7 +517,7 @@ private:
     const Type* infer(InferSema&) const override;
     void check(TypeSema&) const override;
 
-    uint64_t size_;
+    std::unique_ptr<const ASTType> dim_ast_type_;
 };
 
 //------------------------------------------------------------------------------
@@ -582,7 +609,13 @@ public:
 
     const Fn* fn() const { return fn_; }
     void take_address() const { is_address_taken_ = true; }
+    /// May the value of this local - e.g. an owned pointer - outlive the local? Computed by @p TypeSema.
+    bool is_escaping() const { return is_address_taken_ || is_escaping_ || num_uses_ != num_in_place_uses_; }
+    /// Referred to by some @p PathExpr - computed by @p TypeSema.
+    bool is_used() const { return num_uses_ != 0; }
     void emit(CodeGen&, const thorin::Def*) const;
+    /// Emits a mutable local whose slot is initialized from @p init in place.
+    void emit_init(CodeGen&, const Expr* init) const;
     void bind(NameSema&) const;
 
     Stream& stream(Stream&) const override;
@@ -594,6 +627,9 @@ private:
 protected:
     mutable const Fn* fn_;
     mutable bool is_address_taken_ = false;
+    mutable bool is_escaping_ = false;
+    mutable unsigned num_uses_ = 0;
+    mutable unsigned num_in_place_uses_ = 0;
 
     friend class CodeGen;
     friend class InferSema;
@@ -608,11 +644,14 @@ protected:
 
 class ASTTypeParam : public Decl {
 public:
-    ASTTypeParam(Loc loc, const Identifier* id, ASTTypes&& bounds)
+    ASTTypeParam(Loc loc, const Identifier* id, ASTTypes&& bounds, bool is_const = false)
         : Decl(TypeDecl, loc, id)
         , bounds_(std::move(bounds))
+        , is_const_(is_const)
     {}
 
+    /// A @c const parameter stands for an integer - usable as dimension of array and simd types and as value of type @c i32.
+    bool is_const() const { return is_const_; }
     size_t num_bounds() const { return bounds().size(); }
     const ASTTypes& bounds() const { return bounds_; }
     int lambda_depth() const { return lambda_depth_; }
@@ -626,6 +665,7 @@ private:
     const Var* infer(InferSema&) const;
 
     ASTTypes bounds_;
+    bool is_const_;
     mutable int lambda_depth_ = -1;
 
     friend class ASTTypeApp;
@@ -666,7 +706,7 @@ public:
     size_t num_params() const { return params_.size(); }
     const Expr* body() const { return body_.get(); }
     thorin::Continuation* continuation() const { return continuation_; }
-    const thorin::Param* ret_param() const { return ret_param_; }
+    const thorin::Def* ret_param() const { return ret_param_; }
     const thorin::Def* frame() const { return frame_; }
     Stream& stream_params(Stream& p, bool returning) const;
     void fn_bind(NameSema&) const;
@@ -681,7 +721,7 @@ protected:
     std::unique_ptr<const Expr> filter_;
     Params params_;
     mutable thorin::Continuation* continuation_ = nullptr;
-    mutable const thorin::Param* ret_param_ = nullptr;
+    mutable const thorin::Def* ret_param_ = nullptr;
     mutable const thorin::Def* frame_ = nullptr;
 
 private:
@@ -803,7 +843,7 @@ public:
 
     void bind(NameSema&) const override;
     void emit_head(CodeGen&) const override;
-    void emit(CodeGen&) const override {}
+    void emit(CodeGen&) const override;
     Stream& stream(Stream&) const override;
 
 private:
@@ -867,12 +907,16 @@ private:
 
 class StructDecl : public TypeDeclItem {
 public:
-    StructDecl(Loc loc, Visibility vis, const Identifier* id,
+    StructDecl(Loc loc, Visibility vis, Symbol layout, const Identifier* id,
                ASTTypeParams&& ast_type_params, FieldDecls&& field_decls)
         : TypeDeclItem(loc, vis, id, std::move(ast_type_params))
+        , layout_(layout)
         , field_decls_(std::move(field_decls))
     {}
 
+    Symbol layout() const { return layout_; }
+    /// Arrays of this struct are laid out as one array per field (struct-of-arrays).
+    bool is_soa() const { return layout_ == "\"soa\""; }
     size_t num_field_decls() const { return field_decls_.size(); }
     const FieldDecls& field_decls() const { return field_decls_; }
     const FieldTable& field_table() const { return field_table_; }
@@ -891,6 +935,7 @@ private:
     const Type* infer_head(InferSema&) const override;
     void check(TypeSema&) const override;
 
+    Symbol layout_;
     FieldDecls field_decls_;
     mutable FieldTable field_table_;
 };
@@ -998,6 +1043,10 @@ public:
 
     bool is_extern() const { return is_extern_; }
     Symbol abi() const { return abi_; }
+    /// Resolved while binding names; @c Intrinsic::None unless declared in an @c extern @c "thorin" block.
+    Intrinsic intrinsic() const { return intrinsic_; }
+    /// Declared in an @c extern @c "range" block: counts from its first to its second argument - see @p ForExpr.
+    bool is_builtin_range() const { return is_extern() && abi() == "\"range\""; }
 
     const FnType* fn_type() const override {
         auto t = type();
@@ -1006,11 +1055,22 @@ public:
         return t->as<FnType>();
     }
     Symbol fn_symbol() const override { return export_name_ != "" ? export_name_ : identifier()->symbol(); }
+    /// Has type parameters - emitted once for each list of type arguments it is applied to.
+    bool is_generic() const { return type()->isa<Lambda>(); }
+    /**
+     * Generic, has a partial evaluation filter or takes a function.
+     * Module interfaces keep the body of such a function so importers can specialize it - see @p generate_interface.
+     */
+    bool is_inline() const;
 
     void bind(NameSema&) const override;
     void emit_head(CodeGen&) const override;
     void emit(CodeGen&) const override;
+    /// Emits the body into @p continuation while @p CodeGen substitutes the type arguments of the specialization.
+    void emit_specialization(CodeGen&, thorin::Continuation* continuation) const;
     Stream& stream(Stream&) const override;
+    /// Streams everything but a leading @c extern and the body.
+    Stream& stream_head(Stream&) const;
 
 private:
     void infer(InferSema&) const override;
@@ -1020,6 +1080,7 @@ private:
     Symbol abi_;
     Symbol export_name_;
     bool is_extern_ = false;
+    mutable Intrinsic intrinsic_ = Intrinsic::None;
 };
 
 class TraitDecl : public Item, public ASTTypeParamList {
@@ -1121,7 +1182,7 @@ protected:
     /**
      * A back reference to the @p std::unique_ptr which owns this @p Expr.
      * This means that the address is @em not supposed to be changed in the future.
-     * For this reason, @p Exprs is a <tt> std::deque<std::unique_ptr<const Expr>> </tt> and @em not a @c std::vector.
+     * For this reason, @p Exprs is a @p Slots and @em not a @c std::vector.
      */
     mutable std::unique_ptr<const Expr>* back_ref_ = nullptr;
 
@@ -1304,6 +1365,11 @@ public:
     const Decl* value_decl() const {
         return path_->decl() && path_->decl()->is_value_decl() ? path_->decl() : nullptr;
     }
+    /// The @c const type parameter if this path uses one as a value.
+    const ASTTypeParam* const_param() const {
+        auto ast_type_param = path_->decl() ? path_->decl()->isa<ASTTypeParam>() : nullptr;
+        return ast_type_param && ast_type_param->is_const() ? ast_type_param : nullptr;
+    }
 
     void write() const override;
     void take_address() const override;
@@ -1651,7 +1717,7 @@ public:
         friend class StructExpr;
     };
 
-    typedef std::deque<std::unique_ptr<const Elem>> Elems;
+    typedef Slots<const Elem> Elems;
 
     StructExpr(Loc loc, const ASTTypeApp* ast_type_app, Elems&& elems)
         : Expr(loc)
@@ -1721,6 +1787,10 @@ public:
     {}
 
     const Expr* lhs() const { return lhs_.get(); }
+    /// Is this an element access into an array of a struct with @c "soa" layout?
+    bool is_soa_access() const;
+    /// The intrinsic called by this expression or @c Intrinsic::None.
+    Intrinsic intrinsic() const;
 
     void write() const override;
     bool has_side_effect() const override;
@@ -1819,7 +1889,7 @@ public:
         std::unique_ptr<const Expr> expr_;
     };
 
-    typedef std::deque<std::unique_ptr<const Arm>> Arms;
+    typedef Slots<const Arm> Arms;
 
     MatchExpr(Loc loc, const Expr* expr, Arms&& arms)
         : Expr(loc)
@@ -1888,6 +1958,12 @@ public:
     const FnExpr* fn_expr() const { return fn_expr_.get()->as<FnExpr>(); }
     const Expr* expr() const { return expr_.get(); }
     const LocalDecl* break_decl() const { return break_decl_.get(); }
+    /**
+     * The builtin range this loop iterates over, if any.
+     * Such loops are emitted as a counted loop like a @p WhileExpr instead of a call with the body as closure;
+     * loops with a partial evaluation filter are left to the partial evaluator.
+     */
+    const FnDecl* builtin_range() const;
 
     bool has_side_effect() const override;
     void bind(NameSema&) const override;
@@ -1897,6 +1973,7 @@ private:
     const Type* infer(InferSema&) const override;
     void check(TypeSema&) const override;
     const thorin::Def* remit(CodeGen&) const override;
+    const thorin::Def* remit_range(CodeGen&) const;
 
     std::unique_ptr<const Expr> fn_expr_;
     std::unique_ptr<const Expr> expr_;
@@ -2157,7 +2234,7 @@ public:
         std::unique_ptr<const Expr> expr_;
     };
 
-    typedef std::deque<std::unique_ptr<const Elem>> Elems;
+    typedef Slots<const Elem> Elems;
 
     AsmStmt(Loc loc, std::string&& asm_template, Elems&& outputs, Elems&& inputs,
             Strings&& clobbers, Strings&& options)
@@ -12,10 +12,11 @@ Prec prec = Prec::Bottom;
  */
 
 Stream& ErrorASTType::stream(Stream& s) const { return s << "<error>"; }
-Stream& DefiniteArrayASTType::stream(Stream& s) const { return s.fmt("[{} * {}]", elem_ast_type(), dim()); }
+Stream& DefiniteArrayASTType::stream(Stream& s) const { return s.fmt("[{} * {}]", elem_ast_type(), dim_ast_type()); }
+Stream& DimASTType::stream(Stream& s) const { return s << value(); }
 Stream& IndefiniteArrayASTType::stream(Stream& s) const { return s.fmt("[{}]", elem_ast_type()); }
 Stream& TupleASTType::stream(Stream& s) const { return s.fmt("({, })", ast_type_args()); }
-Stream& SimdASTType::stream(Stream& s) const { return s.fmt("simd[{} * {}]", elem_ast_type(), size()); }
+Stream& SimdASTType::stream(Stream& s) const { return s.fmt("simd[{} * {}]", elem_ast_type(), dim_ast_type()); }
 
 Stream& PtrASTType::stream(Stream& s) const {
     s << prefix();
@@ -70,7 +71,7 @@ Stream& Path::stream(Stream& s) const { return s.fmt("{}{::}", is_global() ? "::
  */
 
 Stream& ASTTypeParam::stream(Stream& s) const {
-    s << symbol() << (bounds_.empty() ? "" : ": ");
+    s << (is_const() ? "const " : "") << symbol() << (bounds_.empty() ? "" : ": ");
     return s.fmt("{ + }", bounds());
 }
 
@@ -126,7 +127,14 @@ Stream& ExternBlock::stream(Stream& s) const {
 }
 
 Stream& FnDecl::stream(Stream& s) const {
-    s.fmt("{}fn", is_extern() ? "extern " : "");
+    stream_head(s << (is_extern() ? "extern " : ""));
+    if (body())
+        return s << ' ' << body();
+    return s << ';';
+}
+
+Stream& FnDecl::stream_head(Stream& s) const {
+    s << "fn";
     if (filter()) s.fmt(" @{} ", filter());
 
     s.fmt("{}{}", export_name_ ? (export_name_ + " ") : Symbol(), symbol());
@@ -148,9 +156,7 @@ Stream& FnDecl::stream(Stream& s) const {
             s.fmt("({, })", ret->ast_type_args());
     }
 
-    if (body())
-        return s << ' ' << body();
-    return s << ';';
+    return s;
 }
 
 Stream& FieldDecl::stream(Stream& s) const {
@@ -178,7 +184,7 @@ Stream& StaticItem::stream(Stream& s) const {
 }
 
 Stream& StructDecl::stream(Stream& s) const {
-    stream_ast_type_params(s.fmt("{}struct {}", visibility().str(), symbol()));
+    stream_ast_type_params(s.fmt("{}struct {}{}", visibility().str(), layout_ ? (layout_ + " ") : Symbol(), symbol()));
     return s.fmt(" {{\t\n{,\n}\b\n}}", field_decls());
 }
 
@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <fstream>
+#include <sstream>
 #include <string>
 #include <cassert>
 
@@ -10,6 +12,89 @@
 
 namespace impala {
 
+/// Size and alignment in bytes of @p type in C on a 64 bit target - both zero if it has no C equivalent.
+static std::pair<uint64_t, uint64_t> c_layout(const Type* type) {
+    if (auto prim_type = type->isa<PrimType>()) {
+        switch (prim_type->primtype_tag()) {
+            case PrimType_bool: case PrimType_i8:  case PrimType_u8:                    return {1, 1};
+            case PrimType_i16:  case PrimType_u16: case PrimType_f16:                   return {2, 2};
+            case PrimType_i32:  case PrimType_u32: case PrimType_f32:                   return {4, 4};
+            case PrimType_i64:  case PrimType_u64: case PrimType_f64:                   return {8, 8};
+            default: THORIN_UNREACHABLE;
+        }
+    }
+
+    if (auto ptr_type = type->isa<PtrType>()) {
+        // &[S] is a struct S_soa of one pointer per field of S
+        auto struct_type = soa_struct_type(ptr_type->pointee());
+        if (struct_type && ptr_type->pointee()->isa<IndefiniteArrayType>())
+            return {8 * struct_type->num_ops(), 8};
+        return {8, 8};
+    }
+
+    if (type->isa<FnType>())
+        return {8, 8};
+
+    if (auto simd_type = type->isa<SimdType>()) {
+        auto size = c_layout(simd_type->elem_type()).first * simd_type->dim();
+        return {size, size};
+    }
+
+    if (auto array_type = type->isa<DefiniteArrayType>()) {
+        auto elem = c_layout(array_type->elem_type());
+        return {elem.first * array_type->dim(), elem.second};
+    }
+
+    if (type->isa<StructType>() || type->isa<TupleType>()) {
+        uint64_t size = 0, align = 1;
+        for (auto op : type->ops()) {
+            auto layout = c_layout(op);
+            if (layout.second == 0)
+                return {0, 0};
+            size = (size + layout.second - 1) / layout.second * layout.second + layout.first;
+            align = std::max(align, layout.second);
+        }
+        return {(size + align - 1) / align * align, align};
+    }
+
+    return {0, 0};
+}
+
+/// Structs, tuples and &[S] of soa structs - the values the C ABIs pass in registers or in memory depending on their size.
+static bool is_c_aggregate(const Type* type) {
+    if (auto ptr_type = type->isa<PtrType>())
+        return ptr_type->pointee()->isa<IndefiniteArrayType>() && soa_struct_type(ptr_type->pointee());
+    return type->isa<StructType>() || (type->isa<TupleType>() && type->num_ops() != 0);
+}
+
+bool is_c_indirect(const Type* type, CABI abi) {
+    // like in C, arrays never travel by value
+    if (type->isa<DefiniteArrayType>())
+        return true;
+    if (!is_c_aggregate(type))
+        return false;
+
+    auto size = c_layout(type).first;
+    switch (abi) {
+        case CABI::SysV:    return size > 16;
+        case CABI::Win64:   return size != 1 && size != 2 && size != 4 && size != 8;
+        case CABI::Unknown: return false; // rejected by check_c_abi
+    }
+    THORIN_UNREACHABLE;
+}
+
+bool check_c_abi(const FnDecl* fn, CABI abi) {
+    if (abi != CABI::Unknown)
+        return true;
+    auto fn_type = fn->fn_type();
+    bool aggregate = fn_type->is_returning() && !fn_type->return_type()->isa<TupleType>() && is_c_aggregate(fn_type->return_type());
+    for (size_t i = 0, e = fn_type->num_params() - (fn_type->is_returning() ? 1 : 0); i != e; ++i)
+        aggregate |= is_c_aggregate(fn_type->param(i));
+    if (aggregate)
+        error(fn, "passing structs or tuples across the C ABI is only supported for 64 bit targets");
+    return !aggregate;
+}
+
 class CGen {
 private:
     // Analyses a type to see if it mentions a structure somewhere
@@ -122,6 +207,15 @@ private:
             // &[T] -> T*
             // &[T * N] -> T*
             // &T -> T*
+            // &[S] -> struct S_soa (S has "soa" layout)
+
+            if (auto struct_type = soa_struct_type(ptr_type->pointee())) {
+                if (!ptr_type->pointee()->isa<IndefiniteArrayType>())
+                    return false;
+                ctype_prefix = "struct " + struct_type->struct_decl()->symbol().str() + "_soa";
+                ctype_suffix = "";
+                return true;
+            }
 
             if (auto array_type = ptr_type->pointee()->isa<ArrayType>()) {
                 if (!ctype_from_impala(array_type->elem_type(), ctype_prefix, ctype_suffix))
@@ -138,6 +232,8 @@ private:
         }
 
         if (auto darray_type = type->isa<DefiniteArrayType>()) {
+            if (soa_struct_type(darray_type))
+                return false;
             if (!ctype_from_impala(darray_type->elem_type(), ctype_prefix, ctype_suffix))
                 return false;
             ctype_suffix = "[" + std::to_string(darray_type->dim()) + "]" + ctype_suffix;
@@ -206,7 +302,12 @@ private:
     std::vector<const FnDecl*> export_fns;
 
 public:
+    CGen(CABI c_abi)
+        : c_abi(c_abi)
+    {}
+
     bool needs_vectors = false;
+    CABI c_abi;
 
     void process_module(const Module* mod) {
         for (const auto& item : mod->items()) {
@@ -276,61 +377,182 @@ public:
                 o << "    " << ctype_pref << ' ' << field->symbol() << ctype_suf << ";\n";
             }
             o << "};\n" << std::endl;
+
+            // Layout of &[S]: one pointer per field
+            if (st->is_soa()) {
+                o << "struct " << st->symbol().str() << "_soa {\n";
+                for (const auto& field : st->field_decls()) {
+                    std::string ctype_pref, ctype_suf;
+                    ctype_from_impala(field->type(), ctype_pref, ctype_suf);
+                    if (ctype_suf.empty())
+                        o << "    " << ctype_pref << "* " << field->symbol() << ";\n";
+                    else
+                        o << "    " << ctype_pref << " (*" << field->symbol() << ')' << ctype_suf << ";\n";
+                }
+                o << "};\n" << std::endl;
+            }
         }
 
         return true;
     }
 
-    bool generate_functions(std::ostream& o) const {
-        for (const auto& fn : export_fns) {
-            const auto fn_type = fn->fn_type();
+    /// Large aggregates are returned through this pointer, which precedes all other arguments - see @p is_c_indirect.
+    bool returns_indirectly(const FnDecl* fn) const { return is_c_indirect(fn->fn_type()->return_type(), c_abi); }
 
-            std::string return_pref, return_suf;
-            if (!ctype_from_impala(fn_type->return_type(), return_pref, return_suf)) {
-                error(fn, "function return type not exportable");
-                return false;
-            }
+    /// Writes the C prototype of @p fn under the name @p name without a trailing semicolon.
+    bool generate_prototype(std::ostream& o, const FnDecl* fn, const std::string& name) const {
+        const auto fn_type = fn->fn_type();
+        if (!check_c_abi(fn, c_abi))
+            return false;
+
+        std::string return_pref, return_suf;
+        if (!ctype_from_impala(fn_type->return_type(), return_pref, return_suf)) {
+            error(fn, "function return type not exportable");
+            return false;
+        }
+
+        // We cannot return definite or indefinite arrays from Impala
+        if (return_suf != "") {
+            error(fn, "function returning an array");
+            return false;
+        }
 
-            // We cannot return definite or indefinite arrays from Impala
-            if (return_suf != "") {
-                error(fn, "function returning an array");
+        bool sret = returns_indirectly(fn);
+        o << (sret ? "void" : return_pref) << ' ' << name << '(';
+        if (sret)
+            o << return_pref << "* _result" << (fn_type->num_params() > 1 ? ", " : "");
+
+        // Generate all arguments except the last one which is the implicit continuation
+        for (size_t i = 0, e = fn_type->num_params() - 1; i != e; ++i) {
+            std::string ctype_pref, ctype_suf;
+            if (!ctype_from_impala(fn_type->param(i), ctype_pref, ctype_suf)) {
+                error(fn, "function argument type not exportable");
                 return false;
             }
 
-            o << return_pref << ' ' << fn->symbol() << '(';
+            // arrays decay to pointers anyway
+            if (ctype_suf.empty() && is_c_indirect(fn_type->param(i), c_abi))
+                o << "const " << ctype_pref << "* " << fn->param(i)->symbol();
+            else
+                o << ctype_pref << ' ' << fn->param(i)->symbol() << ctype_suf;
 
-            // Generate all arguments except the last one which is the implicit continuation
-            for (size_t i = 0, e = fn_type->num_params() - 1; i != e; ++i) {
-                std::string ctype_pref, ctype_suf;
-                if (!ctype_from_impala(fn_type->param(i), ctype_pref, ctype_suf)) {
-                    error(fn, "function argument type not exportable");
-                    return false;
-                }
+            if (i < fn_type->num_params() - 2)
+                o << ", ";
+        }
 
-                o << ctype_pref << ' ' << fn->param(i)->symbol() << ctype_suf;
+        // Generate void functions when the function takes no argument to be C89 compatible
+        if (fn_type->num_params() == 1 && !sret) {
+            o << "void";
+        }
 
-                if (i < fn_type->num_params() - 2)
-                    o << ", ";
-            }
+        o << ')';
+        return true;
+    }
 
-            // Generate void functions when the function takes no argument to be C89 compatible
-            if (fn_type->num_params() == 1) {
-                o << "void";
+    bool generate_functions(std::ostream& o) const {
+        for (const auto& fn : export_fns) {
+            if (!generate_prototype(o, fn, fn->symbol().str()))
+                return false;
+            o << ';' << std::endl;
+        }
+
+        return true;
+    }
+
+    /// Forwards each exported function to the variant of the target chosen by @c impala_cpu_target.
+    bool generate_dispatchers(std::ostream& o, const std::vector<CPUTarget>& targets) const {
+        for (const auto& fn : export_fns) {
+            std::ostringstream os;
+            Stream(os).fmt("{}", fn->fn_symbol().remove_quotation());
+            auto name = os.str();
+
+            for (const auto& target : targets) {
+                if (!generate_prototype(o, fn, name + target.suffix))
+                    return false;
+                o << ';' << std::endl;
             }
 
-            o << ");" << std::endl;
+            o << "static __typeof__(" << name << targets.front().suffix << ")* const " << name << "_variants[] = { ";
+            for (const auto& target : targets)
+                o << name << target.suffix << ", ";
+            o << "};\n";
+
+            if (!generate_prototype(o, fn, name))
+                return false;
+            o << " {\n    ";
+            std::string return_pref, return_suf;
+            ctype_from_impala(fn->fn_type()->return_type(), return_pref, return_suf);
+            bool sret = returns_indirectly(fn);
+            if (return_pref != "void" && !sret)
+                o << "return ";
+            o << name << "_variants[impala_cpu_target()](" << (sret ? "_result" : "");
+            for (size_t i = 0, e = fn->fn_type()->num_params() - 1; i != e; ++i)
+                o << (i == 0 && !sret ? "" : ", ") << fn->param(i)->symbol();
+            o << ");\n}\n" << std::endl;
         }
 
         return true;
     }
 };
 
+bool is_dispatchable_feature(const std::string& feature) {
+    // known to __builtin_cpu_supports of both GCC and Clang under the names LLVM uses for the target attributes
+    static const char* features[] = {
+        "cmov", "mmx", "popcnt", "sse", "sse2", "sse3", "ssse3", "sse4.1", "sse4.2", "sse4a", "avx", "avx2", "fma", "fma4", "xop",
+        "bmi", "bmi2", "aes", "pclmul", "gfni", "vpclmulqdq", "avx512f", "avx512vl", "avx512bw", "avx512dq", "avx512cd",
+        "avx512er", "avx512pf", "avx512vbmi", "avx512ifma", "avx5124vnniw", "avx5124fmaps", "avx512vpopcntdq", "avx512vbmi2",
+        "avx512vnni", "avx512bitalg"
+    };
+    return std::find(std::begin(features), std::end(features), feature) != std::end(features);
+}
+
+bool generate_cpu_dispatcher(const Module* mod, const std::vector<CPUTarget>& targets, std::ostream& o, CABI c_abi) {
+    CGen cgen(c_abi);
+    cgen.process_module(mod);
+    cgen.add_dependencies();
+
+    o << "/* CPU dispatcher generated by impala */\n" << std::endl;
+
+    if (cgen.needs_vectors) {
+        o << "#include <immintrin.h>\n" << std::endl;
+    }
+
+    if (!cgen.generate_structs(o))
+        return false;
+
+    // The first target whose attributes are all supported wins; the last one is the fallback - also on all CPUs but x86.
+    // main makes sure that all other targets have attributes and that __builtin_cpu_supports knows them.
+    o << "static int impala_cpu_target(void) {\n"
+      << "    static int target = -1;\n"
+      << "    if (target < 0) {\n"
+      << "        int t = " << targets.size() - 1 << ";\n"
+      << "#if defined(__x86_64__) || defined(__i386__)\n"
+      << "        __builtin_cpu_init();\n";
+    for (size_t i = 0, e = targets.size() - 1; i != e; ++i) {
+        o << "        " << (i == 0 ? "if" : "else if") << " (1";
+        std::istringstream attrs(targets[i].attr);
+        std::string attr;
+        while (std::getline(attrs, attr, ',')) {
+            if (!attr.empty() && attr[0] == '+')
+                o << " && __builtin_cpu_supports(\"" << attr.substr(1) << "\")";
+        }
+        o << ") t = " << i << ";\n";
+    }
+    o << "#endif\n"
+      << "        target = t;\n"
+      << "    }\n"
+      << "    return target;\n"
+      << "}\n" << std::endl;
+
+    return cgen.generate_dispatchers(o, targets);
+}
+
 bool generate_c_interface(const Module* mod, const CGenOptions& opts, std::ostream& o) {
     if (opts.fns_only && opts.structs_only)
         return false;
 
     // Process the ast to find which functions & structures to export
-    CGen cgen;
+    CGen cgen(opts.c_abi);
     cgen.process_module(mod);
     cgen.add_dependencies();
 
@@ -1,7 +1,12 @@
 #ifndef IMPALA_CGEN_H
 #define IMPALA_CGEN_H
 
+#include <cstdint>
 #include <iostream>
+#include <string>
+#include <vector>
+
+#include "impala/impala.h"
 
 namespace impala {
 
@@ -11,12 +16,15 @@ struct CGenOptions {
         , fns_only(false)
         , file_name("interface.h")
         , guard("INTERFACE_H")
+        , c_abi(CABI::SysV)
     {}
 
     bool structs_only : 1;
     bool fns_only : 1;
     std::string file_name;
     std::string guard;
+    /// Has to match @p EmitOptions::c_abi of the compiled module.
+    CABI c_abi;
 };
 
 /**
@@ -30,6 +38,29 @@ struct CGenOptions {
  */
 bool generate_c_interface(const Module* mod, const CGenOptions& opts = CGenOptions(), std::ostream& o = std::cout);
 
+/// A variant of a module compiled for a specific CPU.
+struct CPUTarget {
+    std::string cpu;
+    std::string attr;   ///< LLVM target attributes like @c +avx2,+fma - also checked by the dispatcher
+    std::string suffix; ///< appended to the names of exported functions
+};
+
+/// Whether the dispatcher can check the LLVM target attribute @c +feature via @c __builtin_cpu_supports on x86.
+bool is_dispatchable_feature(const std::string& feature);
+
+/**
+ * Generates C code which provides each exported function of an Impala module and forwards it
+ * to the variant for the first of @p targets supported by the CPU it runs on.
+ * Only the attributes of the targets are checked, and only on x86: everywhere else the last target is taken.
+ *
+ * @param mod The module contents.
+ * @param targets The variants the module was compiled for, best first.
+ * @param o The stream to use as output.
+ * @param c_abi Has to match @p EmitOptions::c_abi of the variants.
+ * @return true on success, otherwise false
+ */
+bool generate_cpu_dispatcher(const Module* mod, const std::vector<CPUTarget>& targets, std::ostream& o, CABI c_abi = CABI::SysV);
+
 }
 
 #endif
@@ -1,9 +1,18 @@
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <unordered_map>
+
 #include "impala/ast.h"
 
 #include "thorin/continuation.h"
 #include "thorin/primop.h"
 #include "thorin/type.h"
 #include "thorin/world.h"
+#include "thorin/analyses/scope.h"
 #include "thorin/util/array.h"
 
 using namespace thorin;
@@ -12,9 +21,21 @@ namespace impala {
 
 class CodeGen {
 public:
-    CodeGen(World& world)
+    CodeGen(World& world, const EmitOptions& opts)
         : world(world)
-    {}
+        , opts(opts)
+    {
+        if (!opts.profile_use.empty())
+            load_profile(opts.profile_use);
+    }
+
+    /*
+     * names - only attached if EmitOptions::names is set
+     */
+
+    void set_name(const Def* def, const char* name) { if (opts.names) def->set_name(name); }
+    void set_name(const Def* def, Symbol symbol) { if (opts.names) def->set_name(symbol.str()); }
+    Debug debug(const Decl* decl) const { return opts.names ? decl->debug() : Debug(decl->loc()); }
 
     /// Continuation of type cn()
     Continuation* basicblock(Debug dbg) { return world.continuation(world.fn_type(), dbg); }
@@ -22,7 +43,7 @@ public:
     /// Continuation of type cn(mem, type) - a point in the program where control flow *j*oins
     Continuation* basicblock(const thorin::Type* type, Debug dbg) {
         auto bb = world.continuation(world.fn_type({world.mem_type(), type}), dbg);
-        bb->param(0)->set_name("mem");
+        set_name(bb->param(0), "mem");
         return bb;
     }
 
@@ -59,7 +80,7 @@ public:
 
         // next is the return continuation
         auto next = world.continuation(world.fn_type(cont_args), dbg);
-        next->param(0)->set_name("mem");
+        set_name(next->param(0), "mem");
 
         // create jump to next
         size_t csize = args.size() + 1;
@@ -76,14 +97,15 @@ public:
             ret = world.tuple(params);
         } else
             ret = next->param(1);
-        ret->set_name(callee->name());
+        if (opts.names)
+            ret->set_name(callee->name());
 
         return std::make_pair(next, ret);
     }
 
     Continuation* create_continuation(const LocalDecl* decl) {
-        auto result = world.continuation(convert(decl->type())->as<thorin::FnType>(), decl->debug());
-        result->param(0)->set_name("mem");
+        auto result = world.continuation(convert(decl->type())->as<thorin::FnType>(), debug(decl));
+        set_name(result->param(0), "mem");
         decl->def_ = result;
         return result;
     }
@@ -106,23 +128,832 @@ public:
         return world.extract(alloc, 1, dbg);
     }
 
+    /// Stores @p value to each of the @p count array elements @p ptr points to in a loop.
+    void fill(const Def* ptr, const Def* value, uint64_t count, bool soa, Loc loc) {
+        auto head_bb = world.continuation(world.fn_type({ world.mem_type(), world.type_qu64() }), {"fill_head", loc});
+        set_name(head_bb->param(0), "mem");
+        auto jump_type = world.fn_type({ world.mem_type() });
+        auto body_bb = world.continuation(jump_type, {"fill_body", loc});
+        auto exit_bb = world.continuation(jump_type, {"fill_exit", loc});
+
+        cur_bb->jump(head_bb, { cur_mem, world.literal_qu64(0, loc) }, loc);
+        auto index = enter(head_bb);
+        cur_bb->branch(cur_mem, world.cmp_lt(index, world.literal_qu64(count, loc), loc), body_bb, exit_bb, loc);
+
+        enter(body_bb, body_bb->param(0));
+        if (soa)
+            soa_store(ptr, index, value, loc);
+        else
+            store(world.lea(ptr, index, loc), value, loc);
+        cur_bb->jump(head_bb, { cur_mem, world.arithop_add(index, world.literal_qu64(1, loc), loc) }, loc);
+
+        enter(exit_bb, exit_bb->param(0));
+    }
+
+    /**
+     * Counts from @p begin up to - excluding - @p end in steps of @p step.
+     * @p body emits the loop body for the given counter; it continues with the next iteration by jumping to the given continuation.
+     */
+    void counted_loop(const Def* begin, const Def* end, const Def* step, std::function<void(const Def*, Continuation*)> body, Loc loc) {
+        auto head_bb = world.continuation(world.fn_type({ world.mem_type(), begin->type() }), {"range_head", loc});
+        set_name(head_bb->param(0), "mem");
+        auto jump_type = world.fn_type({ world.mem_type() });
+        auto body_bb = world.continuation(jump_type, {"range_body", loc});
+        auto next_bb = world.continuation(jump_type, {"range_next", loc});
+        auto exit_bb = world.continuation(jump_type, {"range_exit", loc});
+
+        cur_bb->jump(head_bb, { cur_mem, begin }, loc);
+        auto index = enter(head_bb);
+        cur_bb->branch(cur_mem, world.cmp_lt(index, end, loc), body_bb, exit_bb, loc);
+
+        enter(body_bb, body_bb->param(0));
+        body(index, next_bb);
+
+        enter(next_bb, next_bb->param(0));
+        profile_count("loop", loc);
+        cur_bb->jump(head_bb, { cur_mem, world.arithop_add(index, step, loc) }, loc);
+
+        enter(exit_bb, exit_bb->param(0));
+    }
+
+    void store_init(const Expr* init, const Def* ptr);
+
+    /*
+     * SIMD builtins - lowered to the LLVM intrinsics for vectors
+     */
+
+    /// Name of @p type - a primitive type, a simple enum or a SIMD vector of primitive types - in the names of overloaded LLVM intrinsics.
+    std::string llvm_mangle(const Type* type) {
+        type = instantiate(type);
+        if (auto simd_type = type->isa<SimdType>())
+            return "v" + std::to_string(simd_type->dim()) + llvm_mangle(simd_type->elem_type());
+        if (auto enum_type = type->isa<EnumType>()) {
+            // simple enums are represented by their tag - see convert_rec
+            auto n = enum_type->enum_decl()->num_option_decls();
+            return n <= 0x100 ? "i8" : n <= 0x10000 ? "i16" : "i32";
+        }
+        switch (type->as<PrimType>()->primtype_tag()) {
+            case PrimType_bool:                     return "i1";
+            case PrimType_i8:  case PrimType_u8:    return "i8";
+            case PrimType_i16: case PrimType_u16:   return "i16";
+            case PrimType_i32: case PrimType_u32:   return "i32";
+            case PrimType_i64: case PrimType_u64:   return "i64";
+            case PrimType_f16:                      return "f16";
+            case PrimType_f32:                      return "f32";
+            case PrimType_f64:                      return "f64";
+            default: THORIN_UNREACHABLE;
+        }
+    }
+
+    /// Alignment in bytes of the lanes of @p type - a primitive type or a simple enum - as the LLVM intrinsics expect it.
+    int32_t llvm_align(const Type* type) {
+        auto name = llvm_mangle(type);
+        auto bits = std::stoi(name.substr(1));
+        return bits < 8 ? 1 : bits / 8;
+    }
+
+    /// Name of a pointer to @p pointee in @p addr_space - the pointee only counts for LLVM versions with typed pointers.
+    std::string llvm_mangle_ptr(const Type* pointee, uint64_t addr_space) {
+        return "p" + std::to_string(addr_space) + (opts.typed_pointers ? llvm_mangle(pointee) : std::string());
+    }
+
+    /**
+     * Calls the LLVM intrinsic @p name - an external device function like the ones declared in @c extern @c "device" blocks.
+     * Signed and unsigned lanes share the declaration of the first call; the other types are bitcast to its types and back.
+     */
+    const Def* call_llvm(const std::string& name, Defs args, const thorin::Type* ret_type, Loc loc) {
+        auto& fn = runtime_fns_[name];
+        if (fn == nullptr) {
+            std::vector<const thorin::Type*> fn_types;
+            fn_types.push_back(world.mem_type());
+            for (auto arg : args)
+                fn_types.push_back(arg->type());
+            fn_types.push_back(ret_type ? world.fn_type({ world.mem_type(), ret_type }) : world.fn_type({ world.mem_type() }));
+            fn = world.continuation(world.fn_type(fn_types), {name, loc});
+            world.make_external(fn);
+            fn->attributes().cc = thorin::CC::Device;
+        }
+
+        auto fn_type = fn->type();
+        Array<const Def*> fn_args(args.size() + 1);
+        fn_args[0] = cur_mem;
+        for (size_t i = 0, e = args.size(); i != e; ++i) {
+            auto type = fn_type->op(i + 1);
+            fn_args[i + 1] = args[i]->type() == type ? args[i] : world.bitcast(type, args[i], loc);
+        }
+
+        auto ret_fn_type = fn_type->ops().back()->as<thorin::FnType>();
+        auto fn_ret_type = ret_fn_type->num_ops() > 1 ? ret_fn_type->op(1) : world.tuple_type({});
+        const Def* ret;
+        std::tie(cur_bb, ret) = call(fn, fn_args, fn_ret_type, {name, loc});
+        cur_mem = cur_bb->param(0);
+        return ret_type && fn_ret_type != ret_type ? world.bitcast(ret_type, ret, loc) : ret;
+    }
+
+    /**
+     * Lane @c i of the result is lane <tt>idx[i]</tt> of the concatenation of @p a and @p b.
+     * Thorin has no shuffle: constant indices yield a vector of plain extracts which LLVM combines into a single @c shufflevector;
+     * only indices unknown at compile time select each lane at runtime.
+     */
+    const Def* shuffle(const Def* a, const Def* b, const Def* idx, uint64_t dim, Loc loc) {
+        Array<const Def*> lanes(dim);
+        for (uint64_t i = 0; i != dim; ++i) {
+            auto index = world.convert(world.type_qu64(), world.extract(idx, world.literal_qu32(i, loc), loc), loc);
+            if (auto lit = index->isa<PrimLit>()) {
+                auto j = lit->value().get_qu64();
+                lanes[i] = world.extract(j < dim ? a : b, world.literal_qu32(j % dim, loc), loc);
+                continue;
+            }
+            auto lane = world.arithop_rem(index, world.literal_qu64(dim, loc), loc);
+            auto in_a = world.cmp_lt(index, world.literal_qu64(dim, loc), loc);
+            lanes[i] = world.select(in_a, world.extract(a, lane, loc), world.extract(b, lane, loc), loc);
+        }
+        return world.vector(lanes, loc);
+    }
+
+    /// Address of @p field in element @p index of the struct-of-arrays @p soa.
+    const Def* soa_lea(const Def* soa, const Def* index, size_t field, Loc loc) {
+        // definite arrays sit behind a pointer to a tuple of arrays, indefinite ones are a tuple of pointers
+        auto array = soa->type()->isa<thorin::PtrType>()
+                   ? world.lea(soa, world.literal_qu32(field, loc), loc)
+                   : world.extract(soa, field, loc);
+        return world.lea(array, index, loc);
+    }
+
+    const Def* soa_load(const StructType* struct_type, const Def* soa, const Def* index, Loc loc) {
+        Array<const Def*> fields(struct_type->num_ops());
+        for (size_t i = 0, e = fields.size(); i != e; ++i)
+            fields[i] = load(soa_lea(soa, index, i, loc), loc);
+        return world.struct_agg(convert(struct_type)->as<thorin::StructType>(), fields, loc);
+    }
+
+    void soa_store(const Def* soa, const Def* index, const Def* val, Loc loc) {
+        for (size_t i = 0, e = val->type()->num_ops(); i != e; ++i)
+            store(soa_lea(soa, index, i, loc), world.extract(val, i, loc), loc);
+    }
+
+    /// Element @p index of the struct-of-arrays value @p soa.
+    const Def* soa_extract(const StructType* struct_type, const Def* soa, const Def* index, Loc loc) {
+        Array<const Def*> fields(struct_type->num_ops());
+        for (size_t i = 0, e = fields.size(); i != e; ++i)
+            fields[i] = world.extract(world.extract(soa, i, loc), index, loc);
+        return world.struct_agg(convert(struct_type)->as<thorin::StructType>(), fields, loc);
+    }
+
+    /// Transposes the struct values @p elems into a tuple of per-field definite arrays.
+    const Def* soa_definite_array(const StructType* struct_type, Defs elems, Loc loc) {
+        Array<const Def*> arrays(struct_type->num_ops());
+        for (size_t i = 0, e = arrays.size(); i != e; ++i) {
+            Array<const Def*> field(elems.size());
+            for (size_t j = 0, f = elems.size(); j != f; ++j)
+                field[j] = world.extract(elems[j], i, loc);
+            arrays[i] = world.definite_array(convert(struct_type->op(i)), field, loc);
+        }
+        return world.tuple(arrays, loc);
+    }
+
+    /// Allocates one indefinite array of size @p extra per field of @p struct_type.
+    const Def* soa_alloc(const StructType* struct_type, const Def* extra, Loc loc) {
+        Array<const Def*> ptrs(struct_type->num_ops());
+        for (size_t i = 0, e = ptrs.size(); i != e; ++i)
+            ptrs[i] = alloc(world.indefinite_array_type(convert(struct_type->op(i))), extra, loc);
+        return world.tuple(ptrs, loc);
+    }
+
+    /// How values of an @p EnumType are represented.
+    enum class EnumLayout {
+        Variant, ///< @p thorin::VariantType: index plus largest payload
+        Tag,     ///< no option has a payload: the index as smallest fitting unsigned integer
+        Niche,   ///< a single option carries one pointer into address space 0; all others are encoded as addresses in the first page
+    };
+
+    /// Addresses below this value are never valid and encode the payload-free options of an EnumLayout::Niche.
+    static constexpr size_t niche_limit = 4096;
+
+    static bool mentions(const Type* type, const Type* other) {
+        if (type == other) return true;
+        if (type->is_nominal()) return false; // nominal types are registered before their operands are converted
+        for (auto&& op : type->ops()) {
+            if (mentions(op, other)) return true;
+        }
+        return false;
+    }
+
+    /// Index of the option carrying the pointer if @p decl qualifies for EnumLayout::Niche, @c size_t(-1) otherwise.
+    static size_t niche_option(const EnumDecl* decl) {
+        size_t result = size_t(-1);
+        for (size_t i = 0, e = decl->num_option_decls(); i != e; ++i) {
+            auto option_decl = decl->option_decl(i);
+            if (option_decl->num_args() == 0) continue;
+            if (result != size_t(-1) || option_decl->num_args() != 1) return size_t(-1);
+            result = i;
+        }
+
+        if (result == size_t(-1) || decl->num_option_decls() > niche_limit) return size_t(-1);
+
+        // pointers to indefinite struct-of-arrays are tuples; a pointer back to the enum needs the nominal variant type;
+        // address 0 may be valid in other address spaces - e.g. for shared memory on GPUs
+        auto ptr_type = decl->option_decl(result)->arg(0)->type()->isa<PtrType>();
+        if (!ptr_type || ptr_type->addr_space() != 0 || mentions(ptr_type, decl->enum_type())
+                || (soa_struct_type(ptr_type->pointee()) && ptr_type->pointee()->isa<IndefiniteArrayType>()))
+            return size_t(-1);
+        return result;
+    }
+
+    static EnumLayout enum_layout(const EnumDecl* decl) {
+        if (decl->is_simple()) return EnumLayout::Tag;
+        if (niche_option(decl) != size_t(-1)) return EnumLayout::Niche;
+        return EnumLayout::Variant;
+    }
+
+    /// Value of option @p index of @p enum_type with @p payload (@c nullptr if the option has none).
+    const Def* enum_value(const EnumType* enum_type, size_t index, const Def* payload, Loc loc) {
+        auto decl = enum_type->enum_decl();
+        auto type = convert(enum_type);
+        switch (enum_layout(decl)) {
+            case EnumLayout::Tag:
+                return world.convert(type, world.literal_qu64(index, loc), loc);
+            case EnumLayout::Niche: {
+                auto niche = niche_option(decl);
+                if (index == niche)
+                    return payload;
+                return world.convert(type, world.literal_qu64(index < niche ? index : index - 1, loc), loc);
+            }
+            case EnumLayout::Variant: {
+                auto variant_type = type->as<VariantType>();
+                return world.variant(variant_type, payload ? payload : world.bottom(variant_type->types()[index]), index);
+            }
+        }
+        THORIN_UNREACHABLE;
+    }
+
+    /// Does the enum @p value hold option @p index?
+    const Def* enum_cond(const EnumType* enum_type, const Def* value, size_t index, Loc loc) {
+        auto decl = enum_type->enum_decl();
+        switch (enum_layout(decl)) {
+            case EnumLayout::Tag:
+                return world.cmp_eq(value, enum_value(enum_type, index, nullptr, loc), loc);
+            case EnumLayout::Niche: {
+                auto bits = world.convert(world.type_qu64(), value, loc);
+                if (index == niche_option(decl))
+                    return world.cmp_ge(bits, world.literal_qu64(decl->num_option_decls() - 1, loc), loc);
+                return world.cmp_eq(bits, world.convert(world.type_qu64(), enum_value(enum_type, index, nullptr, loc), loc), loc);
+            }
+            case EnumLayout::Variant:
+                return world.cmp_eq(world.variant_index(value, loc), world.literal_qu64(index, loc), loc);
+        }
+        THORIN_UNREACHABLE;
+    }
+
+    /// Payload of option @p index in the enum @p value.
+    const Def* enum_payload(const EnumType* enum_type, const Def* value, size_t index, Loc loc) {
+        if (enum_layout(enum_type->enum_decl()) == EnumLayout::Niche)
+            return value;
+        return world.variant_extract(value, index, loc);
+    }
+
+    /*
+     * profiling
+     */
+
+    /// Key of the counter for @p kind of code at @p loc - also used to look up counts in a profile.
+    static std::string profile_key(const char* kind, Loc loc) {
+        std::ostringstream os;
+        Stream s(os);
+        s.fmt("{} {}", kind, loc);
+        return os.str();
+    }
+
+    /// External C function @p name of type fn(mem, @p types..., fn(mem)) provided by a runtime library.
+    Continuation* runtime_fn(const char* name, ArrayRef<const thorin::Type*> types, Loc loc) {
+        auto& fn = runtime_fns_[name];
+        if (fn == nullptr) {
+            std::vector<const thorin::Type*> fn_types;
+            fn_types.push_back(world.mem_type());
+            fn_types.insert(fn_types.end(), types.begin(), types.end());
+            fn_types.push_back(world.fn_type({ world.mem_type() }));
+            fn = world.continuation(world.fn_type(fn_types), {name, loc});
+            world.make_external(fn);
+            fn->attributes().cc = thorin::CC::C;
+        }
+        return fn;
+    }
+
+    /// Calls @p fn obtained from @p runtime_fn in the current basic block and continues after the call.
+    void call_runtime(Continuation* fn, Defs args, Debug dbg) {
+        Array<const Def*> fn_args(args.size() + 1);
+        fn_args[0] = cur_mem;
+        std::copy(args.begin(), args.end(), fn_args.begin() + 1);
+        std::tie(cur_bb, std::ignore) = call(fn, fn_args, world.tuple_type({}), dbg);
+        cur_mem = cur_bb->param(0);
+    }
+
+    /// Counts each execution of @p kind of code at @p loc in a counter of its own - see @p emit_profile_table.
+    void profile_count(const char* kind, Loc loc) {
+        if (!opts.profile_generate) return;
+
+        auto counter = world.global(world.literal_pu64(0, loc), true, loc);
+        profile_sites_.emplace_back(counter, profile_key(kind, loc));
+        store(counter, world.arithop_add(load(counter, loc), world.literal_pu64(1, loc), loc), loc);
+    }
+
+    /// Registers the counters of the module with the profiling runtime when a function runs for the first time.
+    void profile_register(Loc loc) {
+        if (!opts.profile_generate) return;
+
+        // the table of all counters only exists after emission - see emit_profile_table
+        if (profile_register_ == nullptr) {
+            profile_registered_ = world.global(world.literal_bool(false, loc), true, loc);
+            profile_register_ = world.continuation(world.fn_type({ world.mem_type(), world.fn_type({ world.mem_type() }) }), {"profile_register", loc});
+        }
+
+        auto jump_type = world.fn_type({ world.mem_type() });
+        auto register_bb = world.continuation(jump_type, {"profile_unregistered", loc});
+        auto next_bb = world.continuation(jump_type, {"profile_registered", loc});
+        cur_bb->branch(cur_mem, load(profile_registered_, loc), next_bb, register_bb, loc);
+
+        enter(register_bb, register_bb->param(0));
+        std::tie(cur_bb, std::ignore) = call(profile_register_, { cur_mem }, world.tuple_type({}), {"profile_register", loc});
+        cur_mem = cur_bb->param(0);
+        cur_bb->jump(next_bb, { cur_mem }, loc);
+
+        enter(next_bb, next_bb->param(0));
+    }
+
+    /// Emits @p profile_register_ which passes the counters and keys of all sites - indexed by site - to @c __impala_profile_register.
+    void emit_profile_table() {
+        if (profile_register_ == nullptr) return;
+
+        auto loc = profile_register_->debug().loc;
+        auto string_type = world.ptr_type(world.indefinite_array_type(world.type_pu8()));
+        Array<const Def*> counters(profile_sites_.size());
+        Array<const Def*> keys(profile_sites_.size());
+        for (size_t i = 0, e = profile_sites_.size(); i != e; ++i) {
+            auto& key = profile_sites_[i].second;
+            Array<const Def*> chars(key.size() + 1);
+            for (size_t j = 0, n = key.size(); j != n; ++j)
+                chars[j] = world.literal_pu8(key[j], loc);
+            chars.back() = world.literal_pu8(0, loc);
+            counters[i] = profile_sites_[i].first;
+            keys[i] = world.bitcast(string_type, world.global(world.definite_array(chars, loc), false, loc), loc);
+        }
+
+        auto counters_type = world.ptr_type(world.indefinite_array_type(counters.front()->type()));
+        auto keys_type = world.ptr_type(world.indefinite_array_type(string_type));
+        enter(profile_register_, profile_register_->param(0));
+        set_name(cur_mem, "mem");
+        store(profile_registered_, world.literal_bool(true, loc), loc);
+        call_runtime(runtime_fn("__impala_profile_register", { counters_type, keys_type, world.type_pu32() }, loc), {
+            world.bitcast(counters_type, world.global(world.definite_array(counters, loc), false, loc), loc),
+            world.bitcast(keys_type, world.global(world.definite_array(keys, loc), false, loc), loc),
+            world.literal_pu32(counters.size(), loc) }, {"profile_register", loc});
+        cur_bb->jump(profile_register_->param(1), { cur_mem }, loc);
+    }
+
+    /**
+     * @p value hinted to be @p expected with @p probability.
+     * LLVM turns the hint into the branch weights of the branch or @c switch on the result when it lowers @c llvm.expect.
+     * The hint is opaque to Thorin, which hence no longer folds a branch on the result even if @p value turns out constant.
+     * Only the LLVM CPU backend understands the hint; for all others @p value is returned as it is.
+     */
+    const Def* expect(const Def* value, const Def* expected, double probability, const std::string& llvm_type, Loc loc) {
+        if (!opts.llvm_cpu)
+            return value;
+        return call_llvm("llvm.expect.with.probability." + llvm_type, { value, expected, world.literal_pf64(probability, loc) }, value->type(), loc);
+    }
+
+    /*
+     * C ABI - see is_c_indirect
+     */
+
+    bool c_indirect(const Type* type) const { return is_c_indirect(type, opts.c_abi); }
+    size_t c_num_values(const FnType* fn_type) const { return fn_type->num_params() - (fn_type->is_returning() ? 1 : 0); }
+    /// Tuple results are returned as several values and thus stay in registers.
+    bool c_sret(const FnType* fn_type) const {
+        return fn_type->is_returning() && !fn_type->return_type()->isa<TupleType>() && c_indirect(fn_type->return_type());
+    }
+
+    bool c_lowered(const FnType* fn_type) const {
+        for (size_t i = 0, e = c_num_values(fn_type); i != e; ++i) {
+            if (c_indirect(fn_type->param(i)))
+                return true;
+        }
+        return c_sret(fn_type);
+    }
+
+    /// fn(mem, [result pointer,] params..., return) with pointers to indirect params.
+    const thorin::FnType* c_abi_type(const FnType* fn_type) {
+        bool sret = c_sret(fn_type);
+        std::vector<const thorin::Type*> ops = { world.mem_type() };
+        if (sret)
+            ops.push_back(world.ptr_type(convert(fn_type->return_type())));
+        for (size_t i = 0, e = c_num_values(fn_type); i != e; ++i) {
+            auto type = convert(fn_type->param(i));
+            ops.push_back(c_indirect(fn_type->param(i)) ? world.ptr_type(type) : type);
+        }
+        if (fn_type->is_returning())
+            ops.push_back(sret ? world.fn_type({ world.mem_type() }) : convert(fn_type->last_param()));
+        return world.fn_type(ops);
+    }
+
+    /**
+     * External function which implements @p fn_decl by the C ABI.
+     * Unless this is the continuation of @p fn_decl itself, the latter becomes a wrapper which
+     * spills indirect arguments to its frame and passes pointers to them.
+     */
+    Continuation* c_abi_import(const FnDecl* fn_decl) {
+        auto fn_type = fn_decl->fn_type();
+        check_c_abi(fn_decl, opts.c_abi);
+        auto wrapper = fn_decl->continuation();
+        if (!c_lowered(fn_type))
+            return wrapper;
+
+        auto loc = fn_decl->loc();
+        auto callee = world.continuation(c_abi_type(fn_type), {fn_decl->fn_symbol().remove_quotation(), loc});
+        THORIN_PUSH(cur_bb, wrapper);
+        auto old_mem = cur_mem;
+        auto entered = world.enter(wrapper->param(0), loc);
+        cur_mem = world.extract(entered, 0_s, loc);
+        auto frame = world.extract(entered, 1_s, loc);
+
+        std::vector<const Def*> args = { nullptr };
+        const Def* result = nullptr;
+        if (c_sret(fn_type))
+            args.push_back(result = world.slot(convert(fn_type->return_type()), frame, loc));
+        for (size_t i = 0, e = c_num_values(fn_type); i != e; ++i) {
+            auto arg = wrapper->param(i + 1);
+            if (c_indirect(fn_type->param(i))) {
+                auto slot = world.slot(arg->type(), frame, loc);
+                store(slot, arg, loc);
+                arg = slot;
+            }
+            args.push_back(arg);
+        }
+        args.front() = cur_mem;
+
+        if (result) {
+            auto next = world.continuation(world.fn_type({ world.mem_type() }), {"sret", loc});
+            args.push_back(next);
+            cur_bb->jump(callee, args, loc);
+            enter(next, next->param(0));
+            auto value = load(result, loc);
+            cur_bb->jump(wrapper->params().back(), { cur_mem, value }, loc);
+        } else {
+            if (fn_type->is_returning())
+                args.push_back(wrapper->params().back());
+            cur_bb->jump(callee, args, loc);
+        }
+
+        cur_mem = old_mem;
+        return callee;
+    }
+
+    /// External function which provides @p fn_decl by the C ABI - loads indirect arguments and forwards them to it.
+    Continuation* c_abi_export(const FnDecl* fn_decl) {
+        auto fn_type = fn_decl->fn_type();
+        check_c_abi(fn_decl, opts.c_abi);
+        auto callee = fn_decl->continuation();
+        if (!c_lowered(fn_type))
+            return callee;
+
+        auto loc = fn_decl->loc();
+        auto exported = world.continuation(c_abi_type(fn_type), {fn_decl->fn_symbol().remove_quotation(), loc});
+        THORIN_PUSH(cur_bb, exported);
+        auto old_mem = cur_mem;
+        cur_mem = exported->param(0);
+
+        size_t p = 1;
+        auto result = c_sret(fn_type) ? exported->param(p++) : nullptr;
+        std::vector<const Def*> args = { nullptr };
+        for (size_t i = 0, e = c_num_values(fn_type); i != e; ++i) {
+            auto arg = exported->param(p++);
+            args.push_back(c_indirect(fn_type->param(i)) ? load(arg, loc) : arg);
+        }
+        args.front() = cur_mem;
+
+        if (result) {
+            const Def* value;
+            std::tie(cur_bb, value) = call(callee, args, convert(fn_type->return_type()), {"sret", loc});
+            cur_mem = cur_bb->param(0);
+            store(result, value, loc);
+            cur_bb->jump(exported->params().back(), { cur_mem }, loc);
+        } else {
+            if (fn_type->is_returning())
+                args.push_back(exported->params().back());
+            cur_bb->jump(callee, args, loc);
+        }
+
+        cur_mem = old_mem;
+        return exported;
+    }
+
+    /*
+     * partial evaluation budgets
+     */
+
+    /// Records @p fn in @p EmitOptions::pe_filters and returns whether its filter is enabled.
+    bool pe_filter(const Fn* fn) { return pe_filter(fn->fn_symbol(), fn->continuation()->debug().loc); }
+
+    /// Records the function which the operand @p expr of @c @@ refers to like @p pe_filter and returns whether to run it.
+    bool pe_run(const Expr* expr) {
+        auto callee = expr;
+        if (auto map_expr = callee->isa<MapExpr>())
+            callee = map_expr->lhs();
+        if (auto type_app_expr = callee->isa<TypeAppExpr>())
+            callee = type_app_expr->lhs();
+        auto path_expr = callee->isa<PathExpr>();
+        auto fn_decl = path_expr && path_expr->value_decl() ? path_expr->value_decl()->isa<FnDecl>() : nullptr;
+        // the copies of other callees - like lambdas - cannot be told apart from the function they are nested in
+        if (fn_decl == nullptr || fn_decl->intrinsic() != Intrinsic::None)
+            return true;
+        return pe_filter(fn_decl->fn_symbol(), fn_decl->loc());
+    }
+
+    /// Records the function @p name at @p loc - once - and returns whether it may still be specialized.
+    bool pe_filter(Symbol name, Loc loc) {
+        PEFilter filter;
+        std::ostringstream name_os, where_os;
+        Stream(name_os).fmt("{}", name.remove_quotation());
+        Stream(where_os).fmt("{}", loc);
+        filter.name = name_os.str();
+        filter.where = where_os.str();
+
+        bool enabled = std::find(opts.pe_disabled.begin(), opts.pe_disabled.end(), filter.where) == opts.pe_disabled.end();
+        auto same = [&] (const PEFilter& other) { return other.where == filter.where; };
+        if (opts.pe_filters && std::none_of(opts.pe_filters->begin(), opts.pe_filters->end(), same))
+            opts.pe_filters->push_back(filter);
+        return enabled;
+    }
+
+    /*
+     * tracing
+     */
+
+    /**
+     * Id passed to the tracing runtime for @p fn or @c nullptr if @p fn is not instrumented.
+     * Functions exported to C are entry points which foreign code may call from threads of its own or after the
+     * trace has been written at exit; they are only instrumented if @p EmitOptions::instrument_filter names them.
+     */
+    const Def* trace_id(const Fn* fn, Loc loc) {
+        auto fn_decl = dynamic_cast<const FnDecl*>(fn);
+        if (!opts.instrument_functions || fn_decl == nullptr) return nullptr;
+        bool exported = (fn_decl->is_extern() && fn_decl->abi() == "") || opts.export_items.count(fn_decl);
+
+        std::ostringstream name_os, where_os;
+        Stream(name_os).fmt("{}", fn->fn_symbol().remove_quotation());
+        Stream(where_os).fmt("{}", loc);
+        auto name = name_os.str(), where = where_os.str();
+
+        if (exported) {
+            if (std::find(opts.instrument_filter.begin(), opts.instrument_filter.end(), name) == opts.instrument_filter.end())
+                return nullptr;
+        } else if (!opts.instrument_filter.empty()) {
+            auto match = [&] (const std::string& filter) {
+                return filter == name || (where.compare(0, filter.size(), filter) == 0 && where[filter.size()] == ':');
+            };
+            if (std::none_of(opts.instrument_filter.begin(), opts.instrument_filter.end(), match))
+                return nullptr;
+        }
+
+        trace_table_.emplace_back(name, where);
+        return world.literal_pu32(u32(trace_table_.size() - 1), loc);
+    }
+
+    /// Emits a call to the tracing runtime recording that the function with @p id has been entered.
+    void trace_enter(const Def* id, Loc loc) {
+        call_runtime(runtime_fn("__impala_trace_enter", { world.type_pu32() }, loc), { id }, {"trace_enter", loc});
+    }
+
+    /// Wraps the return continuation @p ret such that the tracing runtime is told when the function with @p id returns.
+    const Def* trace_exit(const Def* ret, const Def* id, Loc loc) {
+        auto wrapper = world.continuation(ret->type()->as<thorin::FnType>(), {"trace_exit", loc});
+        THORIN_PUSH(cur_bb, wrapper);
+        THORIN_PUSH(cur_mem, wrapper->param(0));
+        call_runtime(runtime_fn("__impala_trace_exit", { world.type_pu32() }, loc), { id }, {"trace_exit", loc});
+
+        Array<const Def*> args(wrapper->num_params());
+        args[0] = cur_mem;
+        for (size_t i = 1, e = args.size(); i != e; ++i)
+            args[i] = wrapper->param(i);
+        cur_bb->jump(ret, args, loc);
+        return wrapper;
+    }
+
+    /// Writes one line '<id> <name> <loc>' per instrumented function - read by the tracing runtime via $IMPALA_TRACE_MAP.
+    void write_trace_table() const {
+        if (opts.trace_table.empty()) return;
+
+        std::ofstream out(opts.trace_table);
+        if (!out) {
+            thorin::errf("cannot open file '{}' for writing", opts.trace_table);
+            return;
+        }
+        for (size_t i = 0, e = trace_table_.size(); i != e; ++i)
+            out << i << ' ' << trace_table_[i].first << ' ' << trace_table_[i].second << std::endl;
+    }
+
+    /// Count recorded in the profile given to -fprofile-use or 0 if unknown.
+    uint64_t profile_count_of(const char* kind, Loc loc) const {
+        auto i = profile_.find(profile_key(kind, loc));
+        return i != profile_.end() ? i->second : 0;
+    }
+
+    /// Reads lines of the form '<count> <key>' as written by the profiling runtime.
+    void load_profile(const std::string& file_name) {
+        std::ifstream in(file_name);
+        if (!in) {
+            thorin::errf("cannot read profile '{}'", file_name);
+            return;
+        }
+
+        uint64_t count;
+        std::string key;
+        while (in >> count && std::getline(in >> std::ws, key))
+            profile_[key] += count;
+    }
+
     const thorin::Type* convert(const Type* type) {
+        // types within generic functions only have a Thorin counterpart in a specialization
+        if (type->is_polymorphic()) {
+            auto t = instantiate(type);
+            if (t != type)
+                return convert(t);
+        }
         if (auto t = thorin_type(type))
             return t;
         auto t = convert_rec(type);
         return thorin_type(type) = t;
     }
 
+    /*
+     * specialization of generic functions
+     */
+
+    struct Specialization {
+        const FnDecl* fn_decl;
+        std::vector<const Type*> type_args;
+        Continuation* continuation;
+    };
+
+    bool specializing() const { return !type_args_.empty(); }
+
+    /// Substitutes the type arguments of the current specialization for the @p Var%s in @p type - structs and enums stay as they are.
+    const Type* instantiate(const Type* type) {
+        if (type->is_monomorphic() || type->is_nominal())
+            return type;
+        if (auto var = type->isa<Var>()) {
+            assert(var->depth() >= 1 && size_t(var->depth()) <= type_args_.size() && "type variable outside of a specialization");
+            return type_args_[var->depth() - 1];
+        }
+        Array<const Type*> ops(type->num_ops());
+        for (size_t i = 0, e = ops.size(); i != e; ++i)
+            ops[i] = instantiate(type->op(i));
+        return type->rebuild(ops);
+    }
+
+    /// Number of elements of a @p DefiniteArrayType or lanes of a @p SimdType.
+    uint64_t dim(const Type* type) {
+        type = instantiate(type);
+        if (auto definite_array_type = type->isa<DefiniteArrayType>())
+            return definite_array_type->dim();
+        return type->as<SimdType>()->dim();
+    }
+
+    /**
+     * Continuation of @p fn_decl applied to @p type_args - emitted once for each list of monomorphic type arguments.
+     * The body is emitted right away unless @p fn_decl is being emitted already; then it waits for @p emit_pending_specializations.
+     */
+    Continuation* specialize(const FnDecl* fn_decl, Types type_args) {
+        // Var%s count from the outermost type parameter - type arguments of enclosing generic functions come first
+        auto num_outer = std::min(type_args_.size(), size_t(fn_decl->ast_type_param(0)->lambda_depth() - 1));
+        std::vector<const Type*> args(type_args_.begin(), type_args_.begin() + num_outer);
+        for (auto type_arg : type_args)
+            args.push_back(instantiate(type_arg));
+
+        auto& continuation = specializations_[std::make_pair(fn_decl, args)];
+        if (continuation == nullptr) {
+            std::swap(type_args_, args);
+            continuation = world.continuation(convert(fn_decl->fn_type())->as<thorin::FnType>(), {fn_decl->fn_symbol().remove_quotation(), fn_decl->loc()});
+            std::swap(type_args_, args);
+
+            Specialization specialization { fn_decl, std::move(args), continuation };
+            if (std::find(cur_generic_fns_.begin(), cur_generic_fns_.end(), fn_decl) != cur_generic_fns_.end())
+                pending_specializations_.push_back(std::move(specialization));
+            else
+                emit_specialization(specialization);
+        }
+        return continuation;
+    }
+
+    void emit_specialization(const Specialization& specialization) {
+        auto type_args = std::move(type_args_);
+        type_args_ = specialization.type_args;
+        cur_generic_fns_.push_back(specialization.fn_decl);
+        specialization.fn_decl->emit_specialization(*this, specialization.continuation);
+        cur_generic_fns_.pop_back();
+        type_args_ = std::move(type_args);
+    }
+
+    void emit_pending_specializations() {
+        while (!pending_specializations_.empty()) {
+            auto specialization = std::move(pending_specializations_.back());
+            pending_specializations_.pop_back();
+            emit_specialization(specialization);
+        }
+    }
+
     const thorin::Type* convert_rec(const Type*);
     const thorin::Type*& thorin_type(const Type* type) { return impala2thorin_[type]; }
 
     World& world;
+    const EmitOptions& opts;
     const Fn* cur_fn = nullptr;
     TypeMap<const thorin::Type*> impala2thorin_;
     Continuation* cur_bb = nullptr;
     const Def* cur_mem = nullptr;
+    std::unordered_map<std::string, Continuation*> runtime_fns_;
+    std::unordered_map<std::string, uint64_t> profile_;
+    std::vector<std::pair<const Def*, std::string>> profile_sites_;    ///< counter and key - indexed by site
+    Continuation* profile_register_ = nullptr;
+    const Def* profile_registered_ = nullptr;
+    std::vector<std::pair<std::string, std::string>> trace_table_;
+    std::vector<const Type*> type_args_;    ///< of the current specialization - indexed by Var::depth() - 1
+    std::map<std::pair<const FnDecl*, std::vector<const Type*>>, Continuation*> specializations_;
+    std::vector<const FnDecl*> cur_generic_fns_;
+    std::vector<Specialization> pending_specializations_;
 };
 
+/// Repeated array literals with more elements are filled in a loop instead of being built as a value.
+static const uint64_t max_repeated_value = 16;
+
+static const RepeatedDefiniteArrayExpr* large_repeated_array(const Expr* expr) {
+    auto repeated = expr->isa<RepeatedDefiniteArrayExpr>();
+    return repeated && repeated->count() > max_repeated_value ? repeated : nullptr;
+}
+
+/**
+ * Where control flow continues after the arms of an @c if or a @c match.
+ * Only if more than one arm yields a value, they meet in a continuation of its own;
+ * otherwise emission simply goes on after the only arm which yields a value.
+ */
+class Join {
+public:
+    Join(CodeGen& cg, const thorin::Type* type, Debug dbg)
+        : cg_(cg)
+        , type_(type)
+        , dbg_(dbg)
+    {}
+
+    /// The current basic block yields @p def - @c nullptr if it does not continue here.
+    void add(const Def* def, Loc loc) {
+        if (def == nullptr)
+            return;
+
+        if (bb_ == nullptr && pred_ == nullptr) {
+            pred_ = cg_.cur_bb;
+            pred_mem_ = cg_.cur_mem;
+            pred_def_ = def;
+            pred_loc_ = loc;
+            return;
+        }
+
+        if (bb_ == nullptr) {
+            bb_ = cg_.basicblock(type_, dbg_);
+            pred_->jump(bb_, { pred_mem_, pred_def_ }, pred_loc_);
+        }
+        cg_.cur_bb->jump(bb_, { cg_.cur_mem, def }, loc);
+    }
+
+    /// Continues emission after the join and returns the joined value.
+    const Def* enter() {
+        if (bb_)
+            return cg_.enter(bb_);
+        if (pred_) {
+            cg_.enter(pred_, pred_mem_);
+            return pred_def_;
+        }
+        return type_ ? cg_.enter(cg_.basicblock(type_, dbg_)) : nullptr; // TODO use bottom type
+    }
+
+private:
+    CodeGen& cg_;
+    const thorin::Type* type_;
+    Debug dbg_;
+    Continuation* bb_ = nullptr;
+    Continuation* pred_ = nullptr;
+    const Def* pred_mem_ = nullptr;
+    const Def* pred_def_ = nullptr;
+    Loc pred_loc_;
+};
+
+/// Stores the value of @p init to @p ptr.
+void CodeGen::store_init(const Expr* init, const Def* ptr) {
+    if (auto repeated = large_repeated_array(init))
+        fill(ptr, repeated->value()->remit(*this), repeated->count(), soa_struct_type(init->type()) != nullptr, init->loc());
+    else
+        store(ptr, init->remit(*this), init->loc());
+}
+
 /*
  * Type
  */
@@ -157,6 +988,16 @@ const thorin::Type* CodeGen::convert_rec(const Type* type) {
         return s;
     } else if (auto enum_type = type->isa<EnumType>()) {
         const auto& decl = enum_type->enum_decl();
+        switch (enum_layout(decl)) {
+            case EnumLayout::Tag: {
+                auto n = decl->num_option_decls();
+                return n <= 0x100 ? world.type_pu8() : n <= 0x10000 ? world.type_pu16() : world.type_pu32();
+            }
+            case EnumLayout::Niche:
+                return convert(decl->option_decl(niche_option(decl))->arg(0)->type());
+            case EnumLayout::Variant:
+                break;
+        }
         auto e = world.variant_type(decl->symbol(), enum_type->num_ops());
         thorin_type(enum_type) = e;
         for(size_t i = 0, n = enum_type->num_ops(); i < n; i++) {
@@ -165,8 +1006,24 @@ const thorin::Type* CodeGen::convert_rec(const Type* type) {
         }
         return e;
     } else if (auto ptr_type = type->isa<PtrType>()) {
-        return world.ptr_type(convert(ptr_type->pointee()), 1, -1, thorin::AddrSpace(ptr_type->addr_space()));
+        auto addr_space = thorin::AddrSpace(ptr_type->addr_space());
+        auto struct_type = soa_struct_type(ptr_type->pointee());
+        if (struct_type && ptr_type->pointee()->isa<IndefiniteArrayType>()) {
+            // struct-of-arrays of unknown size: one pointer per field
+            std::vector<const thorin::Type*> nops;
+            for (auto&& op : struct_type->ops())
+                nops.push_back(world.ptr_type(world.indefinite_array_type(convert(op)), 1, -1, addr_space));
+            return world.tuple_type(nops);
+        }
+        return world.ptr_type(convert(ptr_type->pointee()), 1, -1, addr_space);
     } else if (auto definite_array_type = type->isa<DefiniteArrayType>()) {
+        if (auto struct_type = soa_struct_type(definite_array_type)) {
+            // struct-of-arrays: one definite array per field
+            std::vector<const thorin::Type*> nops;
+            for (auto&& op : struct_type->ops())
+                nops.push_back(world.definite_array_type(convert(op), definite_array_type->dim()));
+            return world.tuple_type(nops);
+        }
         return world.definite_array_type(convert(definite_array_type->elem_type()), definite_array_type->dim());
     } else if (auto indefinite_array_type = type->isa<IndefiniteArrayType>()) {
         return world.indefinite_array_type(convert(indefinite_array_type->elem_type()));
@@ -183,19 +1040,26 @@ const thorin::Type* CodeGen::convert_rec(const Type* type) {
  */
 
 void LocalDecl::emit(CodeGen& cg, const Def* init) const {
-    assert(def_ == nullptr);
+    // bodies of generic functions are emitted once per specialization
+    assert(def_ == nullptr || cg.specializing());
 
     auto thorin_type = cg.convert(type());
     init = init ? init : cg.world.bottom(thorin_type);
 
     if (is_mut()) {
-        def_ = cg.world.slot(thorin_type, cg.frame(), debug());
-        cg.cur_mem = cg.world.store(cg.cur_mem, def_, init, debug());
+        def_ = cg.world.slot(thorin_type, cg.frame(), cg.debug(this));
+        cg.cur_mem = cg.world.store(cg.cur_mem, def_, init, cg.debug(this));
     } else {
         def_ = init;
     }
 }
 
+void LocalDecl::emit_init(CodeGen& cg, const Expr* init) const {
+    assert((def_ == nullptr || cg.specializing()) && is_mut());
+    def_ = cg.world.slot(cg.convert(type()), cg.frame(), cg.debug(this));
+    cg.store_init(init, def_);
+}
+
 const thorin::Type* OptionDecl::variant_type(CodeGen& cg) const {
     std::vector<const thorin::Type*> types;
     for (auto&& arg : args())
@@ -214,12 +1078,14 @@ void Fn::fn_emit_body(CodeGen& cg, Loc loc) const {
     THORIN_PUSH(cg.cur_fn, this);
     THORIN_PUSH(cg.cur_bb, continuation());
     auto old_mem = cg.cur_mem;
+    auto trace_id = cg.trace_id(this, loc);
+    const Def* trace_ret = nullptr;
 
     // setup memory + frame
     {
         size_t i = 0;
         auto mem_param = continuation()->param(i++);
-        mem_param->set_name("mem");
+        cg.set_name(mem_param, "mem");
         auto enter = cg.world.enter(mem_param, loc);
         cg.cur_mem = cg.world.extract(enter, 0_s, loc);
         frame_ =     cg.world.extract(enter, 1_s, loc);
@@ -227,8 +1093,12 @@ void Fn::fn_emit_body(CodeGen& cg, Loc loc) const {
         // name params and setup store locs
         for (auto&& param : params()) {
             auto p = continuation()->param(i++);
-            p->set_name(param->symbol().str());
-            param->emit(cg, p);
+            cg.set_name(p, param->symbol());
+            // returning through the wrapper - also via explicit return and tail calls - leaves the trace
+            if (trace_id && param->symbol() == "return")
+                param->emit(cg, trace_ret = cg.trace_exit(p, trace_id, loc));
+            else
+                param->emit(cg, p);
         }
 
         //assert(i == continuation()->num_params() || continuation()->type() == cg.empty_fn_type);
@@ -236,8 +1106,15 @@ void Fn::fn_emit_body(CodeGen& cg, Loc loc) const {
         if (continuation()->num_params() != 0
                 && continuation()->params().back()->type()->isa<thorin::FnType>())
             ret_param_ = continuation()->params().back();
+        if (trace_ret)
+            ret_param_ = trace_ret;
     }
 
+    if (trace_id)
+        cg.trace_enter(trace_id, loc);
+    cg.profile_register(loc);
+    cg.profile_count("fn", loc);
+
     // descend into body
     auto def = body()->remit(cg);
     if (def) {
@@ -266,6 +1143,10 @@ void Fn::fn_emit_body(CodeGen& cg, Loc loc) const {
                           : global;
         }
 
+        bool has_filter = filter() || std::any_of(params().begin(), params().end(), [] (auto&& param) { return param->filter(); });
+        if (has_filter && cg.pe_filter(this) == false)
+            std::fill(filters.begin(), filters.end(), cg.world.literal_bool(false, loc));
+
         // HACK for unit
         if (auto tuple_type = continuation()->type()->ops().back()->isa<thorin::TupleType>()) {
             if (tuple_type->num_ops() == 0)
@@ -284,49 +1165,48 @@ void Fn::fn_emit_body(CodeGen& cg, Loc loc) const {
 
 void Module::emit(CodeGen& cg) const {
     for (auto&& item : items()) item->emit_head(cg);
+    for (auto&& item : items()) {
+        auto fn_decl = item->isa<FnDecl>();
+        if (fn_decl && !fn_decl->is_extern() && cg.opts.export_items.count(fn_decl))
+            cg.world.make_external(cg.c_abi_export(fn_decl));
+    }
     for (auto&& item : items()) item->emit(cg);
 }
 
-static bool is_polymorphic_primop_or_intrinsic(const std::string& name) {
-    return
-        name == "alignof" ||
-        name == "bitcast" ||
-        name == "insert" ||
-        name == "select" ||
-        name == "sizeof" ||
-        name == "undef" ||
-        name == "reserve_shared" ||
-        name == "atomic" ||
-        name == "atomic_load" ||
-        name == "atomic_store" ||
-        name == "cmpxchg" ||
-        name == "cmpxchg_weak" ||
-        name == "pe_info" ||
-        name == "pe_known";
-}
-
 void FnDecl::emit_head(CodeGen& cg) const {
-    assert(def_ == nullptr);
-    // no code is emitted for primops
-    if (is_extern() && abi() == "\"thorin\"" &&
-        is_polymorphic_primop_or_intrinsic(fn_symbol().remove_quotation()))
+    assert(def_ == nullptr || cg.specializing());
+    // intrinsics are lowered at each call site and generic functions are emitted for each specialization
+    if (intrinsic() != Intrinsic::None || is_generic())
         return;
 
     // create thorin function
     def_ = fn_emit_head(cg, loc());
-    if (is_extern() && abi() == "")
-        cg.world.make_external(continuation());
+    if (is_extern() && abi() == "") {
+        // declarations of exported functions - like in interfaces of modules - refer to other compilation units
+        auto external = body() ? cg.c_abi_export(this) : cg.c_abi_import(this);
+        if (!cg.opts.export_suffix.empty()) {
+            std::ostringstream name;
+            Stream(name).fmt("{}{}", fn_symbol().remove_quotation(), cg.opts.export_suffix);
+            external->set_name(name.str());
+        }
+        cg.world.make_external(external);
+    }
 
     // handle main function
-    if (symbol() == "main")
+    if (symbol() == "main" && cg.opts.export_main)
         cg.world.make_external(continuation());
 }
 
 void FnDecl::emit(CodeGen& cg) const {
-    if (body())
+    if (body() && !is_generic())
         fn_emit_body(cg, loc());
 }
 
+void FnDecl::emit_specialization(CodeGen& cg, Continuation* continuation) const {
+    def_ = continuation_ = continuation;
+    fn_emit_body(cg, loc());
+}
+
 void ExternBlock::emit_head(CodeGen& cg) const {
     for (auto&& fn_decl : fn_decls()) {
         fn_decl->emit_head(cg);
@@ -342,6 +1222,30 @@ void ExternBlock::emit_head(CodeGen& cg) const {
     }
 }
 
+void ExternBlock::emit(CodeGen& cg) const {
+    if (abi() != "\"range\"") return;
+
+    // builtin ranges which are not iterated over by a for loop are called like any other function
+    for (auto&& fn_decl : fn_decls()) {
+        auto continuation = fn_decl->continuation();
+        auto loc = fn_decl->loc();
+        THORIN_PUSH(cg.cur_bb, continuation);
+        auto old_mem = cg.cur_mem;
+        cg.cur_mem = continuation->param(0);
+        cg.set_name(continuation->param(0), "mem");
+
+        // mem, begin, end, [step,] body, return
+        auto n = continuation->num_params();
+        auto body = continuation->param(n - 2);
+        auto step = n == 6 ? continuation->param(3) : cg.world.one(continuation->param(1)->type(), loc);
+        cg.counted_loop(continuation->param(1), continuation->param(2), step, [&] (const Def* index, Continuation* next_bb) {
+            cg.cur_bb->jump(body, { cg.cur_mem, index, next_bb }, loc);
+        }, loc);
+        cg.cur_bb->jump(continuation->param(n - 1), { cg.cur_mem }, loc);
+        cg.cur_mem = old_mem;
+    }
+}
+
 void ModuleDecl::emit(CodeGen&) const {}
 void ImplItem::emit(CodeGen&) const {}
 
@@ -363,10 +1267,8 @@ void StructDecl::emit_head(CodeGen& cg) const {
 
 void OptionDecl::emit(CodeGen& cg) const {
     auto enum_type = enum_decl()->type()->as<EnumType>();
-    auto variant_type = cg.convert(enum_type)->as<VariantType>();
     if (num_args() == 0) {
-        auto bot = cg.world.bottom(variant_type->types()[index()]);
-        def_ = cg.world.variant(variant_type, bot, index());
+        def_ = cg.enum_value(enum_type, index(), nullptr, loc());
     } else {
         auto continuation = cg.world.continuation(cg.convert(type())->as<thorin::FnType>(), {symbol().str(), loc()});
         auto ret = continuation->param(continuation->num_params() - 1);
@@ -375,7 +1277,7 @@ void OptionDecl::emit(CodeGen& cg) const {
         for (size_t i = 1, e = continuation->num_params(); i + 1 < e; i++)
             defs[i-1] = continuation->param(i);
         auto option_val = num_args() == 1 ? defs.back() : cg.world.tuple(defs);
-        auto enum_val = cg.world.variant(variant_type, option_val, index());
+        auto enum_val = cg.enum_value(enum_type, index(), option_val, loc());
         continuation->jump(ret, { mem, enum_val }, loc());
         def_ = continuation;
     }
@@ -424,9 +1326,29 @@ const Def* StrExpr::remit(CodeGen& cg) const {
     return cg.world.definite_array(args, loc());
 }
 
+/// Returns @p expr as @p MapExpr if it reads or writes an element of a struct-of-arrays.
+static const MapExpr* soa_access(const Expr* expr) {
+    auto map_expr = expr->skip_rvalue()->isa<MapExpr>();
+    return map_expr && map_expr->is_soa_access() && map_expr->type()->isa<RefType>() ? map_expr : nullptr;
+}
+
 const Def* CastExpr::remit(CodeGen& cg) const {
     auto def = src()->remit(cg);
     auto thorin_type = cg.convert(type());
+
+    if (auto ptr_type = type()->isa<PtrType>()) {
+        if (soa_struct_type(ptr_type->pointee())) {
+            if (def->type() == thorin_type)
+                return def;
+            // &[S * N] -> &[S]: split the pointer to the tuple of arrays into one pointer per field
+            auto tuple_type = thorin_type->as<thorin::TupleType>();
+            Array<const Def*> ptrs(tuple_type->num_ops());
+            for (size_t i = 0, e = ptrs.size(); i != e; ++i)
+                ptrs[i] = cg.world.bitcast(tuple_type->op(i), cg.world.lea(def, cg.world.literal_qu32(i, loc()), loc()), loc());
+            return cg.world.tuple(ptrs, loc());
+        }
+    }
+
     return cg.world.convert(thorin_type, def, loc());
 }
 
@@ -436,6 +1358,11 @@ const Def* RValueExpr::lemit(CodeGen& cg) const {
 }
 
 const Def* RValueExpr::remit(CodeGen& cg) const {
+    if (auto map_expr = soa_access(src())) {
+        auto struct_type = soa_struct_type(unpack_ref_type(map_expr->lhs()->type()));
+        auto soa = map_expr->lhs()->lemit(cg);
+        return cg.soa_load(struct_type, soa, map_expr->arg(0)->remit(cg), loc());
+    }
     if (src()->type()->isa<RefType>())
         return cg.load(lemit(cg), loc());
     return src()->remit(cg);
@@ -447,6 +1374,8 @@ const Def* PathExpr::lemit(CodeGen&) const {
 }
 
 const Def* PathExpr::remit(CodeGen& cg) const {
+    if (auto ast_type_param = const_param())
+        return cg.world.literal_qs32(s32(cg.instantiate(ast_type_param->var())->as<DimType>()->value()), loc());
     auto def = value_decl()->def();
     // This whole global thing is incorrect.
     // Example:
@@ -478,6 +1407,18 @@ const Def* PrefixExpr::remit(CodeGen& cg) const {
         case SUB: return cg.world.arithop_minus(rhs()->remit(cg), loc());
         case NOT: return cg.world.arithop_not(rhs()->remit(cg), loc());
         case TILDE: {
+            if (auto struct_type = soa_struct_type(rhs()->type())) {
+                if (rhs()->type()->isa<IndefiniteArrayType>()) {
+                    rhs()->remit(cg); // only computes the extent
+                    return cg.soa_alloc(struct_type, rhs()->extra(), loc());
+                }
+            }
+            if (large_repeated_array(rhs())) {
+                auto ptr = cg.alloc(cg.convert(rhs()->type()), nullptr, loc());
+                cg.store_init(rhs(), ptr);
+                return ptr;
+            }
+
             auto def = rhs()->remit(cg);
             auto ptr = cg.alloc(def->type(), rhs()->extra(), loc());
             cg.store(ptr, def, loc());
@@ -500,6 +1441,9 @@ const Def* PrefixExpr::remit(CodeGen& cg) const {
         }
         case RUNRUN: {
             auto def = rhs()->skip_rvalue()->remit(cg);
+            // a function over its budget is left to its filter
+            if (!cg.pe_run(rhs()->skip_rvalue()))
+                return def;
             return cg.world.run(def, loc());
         }
         case HLT: {
@@ -557,19 +1501,35 @@ const Def* InfixExpr::remit(CodeGen& cg) const {
     switch (tag()) {
         case OROR:
         case ANDAND: {
-            auto result     = cg.basicblock(cg.world.type_bool(), { "infix_result", loc().anew_finis() });
-            auto jump_type  = cg.world.fn_type({ cg.world.mem_type() });
-            auto jump_true  = cg.world.continuation(jump_type, { "jump_true", loc().anew_finis() });
-            auto jump_false = cg.world.continuation(jump_type, { "jump_true", loc().anew_finis() });
-            emit_branch(cg, jump_true, jump_false);
-            jump_true->jump(result, { jump_true->param(0), cg.world.literal(true) });
-            jump_false->jump(result, { jump_false->param(0), cg.world.literal(false) });
+            // the value of rhs is the result unless lhs short-circuits
+            bool is_or = tag() == OROR;
+            auto result    = cg.basicblock(cg.world.type_bool(), { "infix_result", loc().anew_finis() });
+            auto jump_type = cg.world.fn_type({ cg.world.mem_type() });
+            auto rhs_bb    = cg.world.continuation(jump_type, { is_or ? "or_false" : "and_true", rhs()->loc().anew_begin() });
+            auto short_bb  = cg.world.continuation(jump_type, { is_or ? "or_true" : "and_false", loc().anew_finis() });
+            if (is_or)
+                lhs()->emit_branch(cg, short_bb, rhs_bb);
+            else
+                lhs()->emit_branch(cg, rhs_bb, short_bb);
+            short_bb->jump(result, { short_bb->param(0), cg.world.literal(is_or) }, loc().anew_finis());
+
+            cg.enter(rhs_bb, rhs_bb->param(0));
+            auto rdef = rhs()->remit(cg);
+            cg.cur_bb->jump(result, { cg.cur_mem, rdef }, loc().anew_finis());
             return cg.enter(result);
         }
         default:
             const TokenTag op = (TokenTag) tag();
 
             if (Token::is_assign(op)) {
+                if (auto map_expr = soa_access(lhs())) {
+                    assert(op == Token::ASGN && "structs do not support compound assignment");
+                    auto soa = map_expr->lhs()->lemit(cg);
+                    auto index = map_expr->arg(0)->remit(cg);
+                    cg.soa_store(soa, index, rhs()->remit(cg), loc());
+                    return cg.world.tuple({}, loc());
+                }
+
                 auto lvar = lhs()->lemit(cg);
                 auto rdef = rhs()->remit(cg);
 
@@ -600,12 +1560,23 @@ const Def* DefiniteArrayExpr::remit(CodeGen& cg) const {
     Array<const Def*> thorin_args(num_args());
     for (size_t i = 0, e = num_args(); i != e; ++i)
         thorin_args[i] = arg(i)->remit(cg);
+    if (auto struct_type = soa_struct_type(type()))
+        return cg.soa_definite_array(struct_type, thorin_args, loc());
     return cg.world.definite_array(cg.convert(type())->as<thorin::DefiniteArrayType>()->elem_type(), thorin_args, loc());
 }
 
 const Def* RepeatedDefiniteArrayExpr::remit(CodeGen& cg) const {
+    // static initializers have no frame and must be constant
+    if (cg.cur_fn != nullptr && large_repeated_array(this)) {
+        auto slot = cg.world.slot(cg.convert(type()), cg.frame(), loc());
+        cg.store_init(this, slot);
+        return cg.load(slot, loc());
+    }
+
     Array<const Def*> args(count());
     std::fill_n(args.begin(), count(), value()->remit(cg));
+    if (auto struct_type = soa_struct_type(type()))
+        return cg.soa_definite_array(struct_type, args, loc());
     return cg.world.definite_array(args, loc());
 }
 
@@ -618,6 +1589,8 @@ const Def* TupleExpr::remit(CodeGen& cg) const {
 
 const Def* IndefiniteArrayExpr::remit(CodeGen& cg) const {
     extra_ = dim()->remit(cg);
+    if (soa_struct_type(type()))
+        return nullptr; // allocated field by field - see PrefixExpr::remit
     return cg.world.indefinite_array(cg.convert(type())->as<thorin::IndefiniteArrayType>()->elem_type(), extra_, loc());
 }
 
@@ -636,9 +1609,14 @@ const Def* StructExpr::remit(CodeGen& cg) const {
 }
 
 const Def* TypeAppExpr::lemit(CodeGen&) const { THORIN_UNREACHABLE; }
-const Def* TypeAppExpr::remit(CodeGen& /*cg*/) const { THORIN_UNREACHABLE; }
+const Def* TypeAppExpr::remit(CodeGen& cg) const {
+    // only generic functions are applied to types - intrinsics are handled by MapExpr
+    auto fn_decl = lhs()->as<PathExpr>()->value_decl()->as<FnDecl>();
+    return cg.specialize(fn_decl, type_args());
+}
 
 const Def* MapExpr::lemit(CodeGen& cg) const {
+    assert(!is_soa_access() && "elements of a struct-of-arrays do not have an address");
     auto agg = lhs()->lemit(cg);
     return cg.world.lea(agg, arg(0)->remit(cg), loc());
 }
@@ -648,124 +1626,61 @@ const Def* MapExpr::remit(CodeGen& cg) const {
 
     if (auto fn_type = ltype->isa<FnType>()) {
         const Def* dst = nullptr;
+        std::vector<const Def*> defs;
+        defs.push_back(nullptr);    // reserve for mem but set later - some other args may update mem
 
-        // Handle primops here
-        if (auto type_expr = lhs()->isa<TypeAppExpr>()) { // alignof, bitcast, sizeof, and select are all polymorphic
-            auto callee = type_expr->lhs()->skip_rvalue();
-            if (auto path = callee->isa<PathExpr>()) {
-                if (auto fn_decl = path->value_decl()->isa<FnDecl>()) {
-                    if (fn_decl->is_extern() && fn_decl->abi() == "\"thorin\"") {
-                        auto name = fn_decl->fn_symbol().remove_quotation();
-                        auto string_type = cg.world.ptr_type(cg.world.indefinite_array_type(cg.world.type_pu8()));
-                        if (name == "alignof") {
-                            return cg.world.align_of(cg.convert(type_expr->type_arg(0)), loc());
-                        } else if (name == "bitcast") {
-                            return cg.world.bitcast(cg.convert(type_expr->type_arg(0)), arg(0)->remit(cg), loc());
-                        } else if (name == "insert") {
-                            return cg.world.insert(arg(0)->remit(cg), arg(1)->remit(cg), arg(2)->remit(cg), loc());
-                        } else if (name == "select") {
-                            return cg.world.select(arg(0)->remit(cg), arg(1)->remit(cg), arg(2)->remit(cg), loc());
-                        } else if (name == "sizeof") {
-                            return cg.world.size_of(cg.convert(type_expr->type_arg(0)), loc());
-                        } else if (name == "undef") {
-                            return cg.world.bottom(cg.convert(type_expr->type_arg(0)), loc());
-                        } else if (name == "reserve_shared") {
-                            auto ptr_type = cg.convert(type());
-                            auto fn_type = cg.world.fn_type({
-                                cg.world.mem_type(), cg.world.type_qs32(),
-                                cg.world.fn_type({ cg.world.mem_type(), ptr_type }) });
-                            auto cont = cg.world.continuation(fn_type, {"reserve_shared", loc()});
-                            cont->set_intrinsic();
-                            dst = cont;
-                        } else if (name == "atomic") {
-                            auto poly_type = cg.convert(type());
-                            auto ptr_type = cg.convert(arg(1)->type());
-                            auto fn_type = cg.world.fn_type({
-                                cg.world.mem_type(), cg.world.type_pu32(), ptr_type, poly_type, cg.world.type_pu32(), string_type,
-                                cg.world.fn_type({ cg.world.mem_type(), poly_type }) });
-                            auto cont = cg.world.continuation(fn_type, {"atomic", loc()});
-                            cont->set_intrinsic();
-                            dst = cont;
-                        } else if (name == "atomic_load") {
-                            auto ptr_type = cg.convert(arg(0)->type());
-                            auto poly_type = ptr_type->as<thorin::PtrType>()->pointee();
-                            auto fn_type = cg.world.fn_type({
-                                cg.world.mem_type(), ptr_type, cg.world.type_pu32(), string_type,
-                                cg.world.fn_type({ cg.world.mem_type(), poly_type })
-                            });
-                            auto cont = cg.world.continuation(fn_type, {"atomic_load", loc()});
-                            cont->set_intrinsic();
-                            dst = cont;
-                        } else if (name == "atomic_store") {
-                            auto ptr_type = cg.convert(arg(0)->type());
-                            auto poly_type = ptr_type->as<thorin::PtrType>()->pointee();
-                            auto fn_type = cg.world.fn_type({
-                                cg.world.mem_type(), ptr_type, poly_type, cg.world.type_pu32(), string_type,
-                                cg.world.fn_type({ cg.world.mem_type() })
-                            });
-                            auto cont = cg.world.continuation(fn_type, {"atomic_store", loc()});
-                            cont->set_intrinsic();
-                            dst = cont;
-                        } else if (name == "cmpxchg" || name == "cmpxchg_weak") {
-                            auto ptr_type = cg.convert(arg(0)->type());
-                            auto poly_type = ptr_type->as<thorin::PtrType>()->pointee();
-                            auto fn_type = cg.world.fn_type({
-                                cg.world.mem_type(), ptr_type, poly_type, poly_type, cg.world.type_pu32(), cg.world.type_pu32(), string_type,
-                                cg.world.fn_type({ cg.world.mem_type(), poly_type, cg.world.type_bool() })
-                            });
-                            auto cont = cg.world.continuation(fn_type, {name, loc()});
-                            cont->set_intrinsic();
-                            dst = cont;
-                        } else if (name == "pe_info") {
-                            auto poly_type = cg.convert(arg(1)->type());
-                            auto fn_type = cg.world.fn_type({
-                                cg.world.mem_type(), string_type, poly_type,
-                                cg.world.fn_type({ cg.world.mem_type() }) });
-                            auto cont = cg.world.continuation(fn_type, {"pe_info", loc()});
-                            cont->set_intrinsic();
-                            dst = cont;
-                        } else if (name == "pe_known") {
-                            auto poly_type = cg.convert(arg(0)->type());
-                            auto fn_type = cg.world.fn_type({
-                                cg.world.mem_type(), poly_type,
-                                cg.world.fn_type({ cg.world.mem_type(), cg.world.type_bool() }) });
-                            auto cont = cg.world.continuation(fn_type, {"pe_known", loc()});
-                            cont->set_intrinsic();
-                            dst = cont;
-                        }
-                    }
-                }
+        auto intrinsic = this->intrinsic();
+        if (intrinsic != Intrinsic::None) {
+            IntrinsicCall call { cg, cg.world, this, {}, {}, cg.convert(type()), loc() };
+            if (auto type_app_expr = lhs()->isa<TypeAppExpr>()) {
+                for (auto type_arg : type_app_expr->type_args())
+                    call.type_args.push_back(cg.convert(type_arg));
             }
+            for (auto&& arg : args())
+                call.args.push_back(arg.get()->remit(cg));
+
+            if (auto def = intrinsic_info(intrinsic).lower(call))
+                return def;
+            assert(call.callee && "lowering of intrinsic yields neither a result nor a callee");
+            dst = call.callee;
+            defs.insert(defs.end(), call.args.begin(), call.args.end());
+        } else {
+            dst = lhs()->remit(cg);
+            for (auto&& arg : args())
+                defs.push_back(arg.get()->remit(cg));
         }
-
-        dst = dst ? dst : lhs()->remit(cg);
-
-        std::vector<const Def*> defs;
-        defs.push_back(nullptr);    // reserve for mem but set later - some other args may update mem
-        for (auto&& arg : args())
-            defs.push_back(arg.get()->remit(cg));
         defs.front() = cg.cur_mem; // now get the current memory value
 
         auto ret_type = num_args() == fn_type->num_params() ? nullptr : cg.convert(fn_type->return_type());
         const Def* ret;
-        std::tie(cg.cur_bb, ret) = cg.call(dst, defs, ret_type, {dst->name() + "_cont", loc()});
+        auto dbg = cg.opts.names ? Debug{dst->name() + "_cont", loc()} : Debug(loc());
+        std::tie(cg.cur_bb, ret) = cg.call(dst, defs, ret_type, dbg);
         if (ret_type)
             cg.cur_mem = cg.cur_bb->param(0);
 
         return ret;
     } else if (ltype->isa<ArrayType>() || ltype->isa<TupleType>() || ltype->isa<SimdType>()) {
         auto index = arg(0)->remit(cg);
+        if (auto struct_type = soa_struct_type(ltype))
+            return cg.soa_extract(struct_type, lhs()->remit(cg), index, loc());
         return cg.world.extract(lhs()->remit(cg), index, loc());
     }
     THORIN_UNREACHABLE;
 }
 
 const Def* FieldExpr::lemit(CodeGen& cg) const {
+    if (auto map_expr = soa_access(lhs())) {
+        auto soa = map_expr->lhs()->lemit(cg);
+        return cg.soa_lea(soa, map_expr->arg(0)->remit(cg), index(), loc());
+    }
     auto value = lhs()->lemit(cg);
     return cg.world.lea(value, cg.world.literal_qu32(index(), loc()), loc());
 }
 
 const Def* FieldExpr::remit(CodeGen& cg) const {
+    // only load the accessed field instead of the whole struct
+    if (soa_access(lhs()))
+        return cg.load(lemit(cg), loc());
     return cg.world.extract(lhs()->remit(cg), index(), loc());
 }
 
@@ -786,27 +1701,25 @@ const Def* IfExpr::remit(CodeGen& cg) const {
     auto jump_type = cg.world.fn_type({ cg.world.mem_type() });
     auto if_then = cg.world.continuation(jump_type, {"if_then", then_expr()->loc().anew_begin()});
     auto if_else = cg.world.continuation(jump_type, {"if_else", else_expr()->loc().anew_begin()});
-    auto if_join = thorin_type ? cg.basicblock(thorin_type, {"if_join", loc().anew_finis()}) : nullptr; // TODO rewrite with bottom type
+    Join if_join(cg, thorin_type, {"if_join", loc().anew_finis()});
 
     cond()->emit_branch(cg, if_then, if_else);
 
     cg.enter(if_then, if_then->param(0));
-    if (auto tdef = then_expr()->remit(cg))
-        cg.cur_bb->jump(if_join, {cg.cur_mem, tdef}, loc().anew_finis());
+    cg.profile_count("then", then_expr()->loc());
+    if_join.add(then_expr()->remit(cg), loc().anew_finis());
 
     cg.enter(if_else, if_else->param(0));
-    if (auto fdef = else_expr()->remit(cg))
-        cg.cur_bb->jump(if_join, {cg.cur_mem, fdef}, loc().anew_finis());
+    cg.profile_count("else", else_expr()->loc());
+    if_join.add(else_expr()->remit(cg), loc().anew_finis());
 
-    if (thorin_type)
-        return cg.enter(if_join);
-    return nullptr; // TODO use bottom type
+    return if_join.enter();
 }
 
 const Def* MatchExpr::remit(CodeGen& cg) const {
     auto thorin_type = cg.convert(type());
 
-    auto join = thorin_type ? cg.basicblock(thorin_type, {"match_join", loc().anew_finis()}) : nullptr; // TODO rewrite with bottom type
+    Join join(cg, thorin_type, {"match_join", loc().anew_finis()});
 
     auto matcher = expr()->remit(cg);
     auto enum_type = expr()->type()->isa<EnumType>();
@@ -833,7 +1746,7 @@ const Def* MatchExpr::remit(CodeGen& cg) const {
                 } else {
                     auto enum_ptrn = arm(i)->ptrn()->as<EnumPtrn>();
                     auto option_decl = enum_ptrn->path()->decl()->as<OptionDecl>();
-                    defs[i] = cg.world.literal_qu64(option_decl->index(), arm(i)->ptrn()->loc());
+                    defs[i] = cg.enum_value(enum_type, option_decl->index(), nullptr, arm(i)->ptrn()->loc());
                 }
                 targets[i] = cg.basicblock({"case", arm(i)->loc().anew_begin()});
             }
@@ -842,21 +1755,46 @@ const Def* MatchExpr::remit(CodeGen& cg) const {
         targets.shrink(num_targets);
         defs.shrink(num_targets);
 
-        auto matcher_int = is_integer ? matcher : cg.world.variant_index(matcher, matcher->debug());
-        cg.cur_bb->match(cg.cur_mem, matcher_int, otherwise, defs, targets, {"match", loc().anew_begin()});
+        // the values are distinct, so the most frequent targets may come first
+        Array<const Def*> ordered_defs(num_targets);
+        Array<Continuation*> ordered_targets(num_targets);
+        {
+            Array<size_t> order(num_targets);
+            std::iota(order.begin(), order.end(), 0);
+            if (!cg.profile_.empty()) {
+                std::stable_sort(order.begin(), order.end(), [&] (size_t a, size_t b) {
+                    return cg.profile_count_of("arm", arm(a)->loc()) > cg.profile_count_of("arm", arm(b)->loc());
+                });
+            }
+            for (size_t i = 0; i != num_targets; ++i) {
+                ordered_defs[i]    = defs[order[i]];
+                ordered_targets[i] = targets[order[i]];
+            }
+
+            // the order alone does not change the code LLVM generates for a switch - the weights of a dominant target do
+            uint64_t total = 0;
+            for (size_t i = 0, e = num_arms(); i != e; ++i)
+                total += cg.profile_count_of("arm", arm(i)->loc());
+            auto hot = num_targets != 0 ? cg.profile_count_of("arm", arm(order[0])->loc()) : 0;
+            if (2 * hot > total && !matcher->isa<PrimLit>())
+                matcher = cg.expect(matcher, defs[order[0]], double(hot) / double(total), cg.llvm_mangle(expr()->type()), loc().anew_begin());
+        }
+
+        // simple enums are represented by their tag
+        cg.cur_bb->match(cg.cur_mem, matcher, otherwise, ordered_defs, ordered_targets, {"match", loc().anew_begin()});
         auto mem = cg.cur_mem;
 
         for (size_t i = 0; i != num_targets; ++i) {
             cg.enter(targets[i], mem);
-            if (auto def = arm(i)->expr()->remit(cg))
-                cg.cur_bb->jump(join, {cg.cur_mem, def}, loc().anew_finis());
+            cg.profile_count("arm", arm(i)->loc());
+            join.add(arm(i)->expr()->remit(cg), loc().anew_finis());
         }
 
         bool no_otherwise = num_arms() == num_targets;
         if (!no_otherwise) {
             cg.enter(otherwise, mem);
-            if (auto def = arm(num_targets)->expr()->remit(cg))
-                cg.cur_bb->jump(join, {cg.cur_mem, def}, loc().anew_finis());
+            cg.profile_count("arm", arm(num_targets)->loc());
+            join.add(arm(num_targets)->expr()->remit(cg), loc().anew_finis());
         }
     } else {
         // general case: if/else
@@ -873,31 +1811,40 @@ const Def* MatchExpr::remit(CodeGen& cg) const {
                 ? cg.world.literal_bool(true, arm(i)->ptrn()->loc())
                 : arm(i)->ptrn()->emit_cond(cg, matcher);
 
+            // probability of this arm given that none of the previous ones matched
+            uint64_t rest = 0;
+            for (size_t j = i; j != e; ++j)
+                rest += cg.profile_count_of("arm", arm(j)->loc());
+            if (rest != 0 && !cond->isa<PrimLit>()) {
+                auto probability = double(cg.profile_count_of("arm", arm(i)->loc())) / double(rest);
+                cond = cg.expect(cond, cg.world.literal_bool(true, arm(i)->ptrn()->loc()), probability, "i1", arm(i)->ptrn()->loc());
+            }
+
             cg.cur_bb->branch(cg.cur_mem, cond, case_true, case_false, arm(i)->ptrn()->loc().anew_finis());
 
             cg.enter(case_true, ct_param);
-            if (auto def = arm(i)->expr()->remit(cg))
-                cg.cur_bb->jump(join, {cg.cur_mem, def}, arm(i)->loc().anew_finis());
+            cg.profile_count("arm", arm(i)->loc());
+            join.add(arm(i)->expr()->remit(cg), arm(i)->loc().anew_finis());
 
             cg.enter(case_false, cf_param);
         }
     }
 
-    if (thorin_type)
-        return cg.enter(join);
-    return nullptr; // TODO use bottom type
+    return join.enter();
 }
 
 const Def* WhileExpr::remit(CodeGen& cg) const {
     auto head_bb = cg.world.continuation(cg.world.fn_type({cg.world.mem_type()}), {"while_head", loc().anew_begin()});
-    head_bb->param(0)->set_name("mem");
+    cg.set_name(head_bb->param(0), "mem");
 
     auto jump_type = cg.world.fn_type({ cg.world.mem_type() });
     auto body_bb = cg.world.continuation(jump_type, {"while_body", body()->loc().anew_begin()});
-    auto exit_bb = cg.world.continuation(jump_type, {"while_exit", body()->loc().anew_finis()});
 
-    auto cont_bb = cg.create_continuation(continue_decl());
-    auto brk__bb = cg.create_continuation(break_decl());
+    // continue and break only get continuations of their own if the body refers to them
+    auto cont_bb = continue_decl()->is_used() ? cg.create_continuation(continue_decl()) : nullptr;
+    auto exit_bb = break_decl()->is_used() ? cg.create_continuation(break_decl())
+                                           : cg.world.continuation(jump_type, {"while_exit", body()->loc().anew_finis()});
+    cg.set_name(exit_bb->param(0), "mem");
 
     cg.cur_bb->jump(head_bb, {cg.cur_mem}, cond()->loc().anew_finis());
 
@@ -906,19 +1853,21 @@ const Def* WhileExpr::remit(CodeGen& cg) const {
 
     cg.enter(body_bb, body_bb->param(0));
     body()->remit(cg);
-    cg.cur_bb->jump(cont_bb, {cg.cur_mem}, body()->loc().anew_finis());
-
-    cg.enter(cont_bb, cont_bb->param(0));
+    if (cont_bb) {
+        cg.cur_bb->jump(cont_bb, {cg.cur_mem}, body()->loc().anew_finis());
+        cg.enter(cont_bb, cont_bb->param(0));
+    }
+    cg.profile_count("loop", body()->loc().anew_finis());
     cg.cur_bb->jump(head_bb, {cg.cur_mem}, body()->loc().anew_finis());
 
     cg.enter(exit_bb, exit_bb->param(0));
-    cg.cur_bb->jump(brk__bb, {cg.cur_mem}, body()->loc().anew_finis());
-
-    cg.enter(brk__bb, brk__bb->param(0));
     return cg.world.tuple({}, loc());
 }
 
 const Def* ForExpr::remit(CodeGen& cg) const {
+    if (builtin_range())
+        return remit_range(cg);
+
     std::vector<const Def*> args;
     args.push_back(nullptr); // reserve for mem but set later - some other args may update the monad
 
@@ -946,6 +1895,30 @@ const Def* ForExpr::remit(CodeGen& cg) const {
     }
 }
 
+const Def* ForExpr::remit_range(CodeGen& cg) const {
+    auto map_expr = expr()->as<MapExpr>();
+    auto break_bb = cg.create_continuation(break_decl());
+
+    // begin, end, [step]
+    Array<const Def*> args(map_expr->num_args());
+    for (size_t i = 0, e = args.size(); i != e; ++i)
+        args[i] = map_expr->arg(i)->remit(cg);
+    auto step = args.size() == 3 ? args[2] : cg.world.one(args[0]->type(), map_expr->loc());
+
+    // the body of the loop goes right into the current function - its last param becomes the jump to the next iteration
+    auto fn = fn_expr();
+    cg.counted_loop(args[0], args[1], step, [&] (const Def* index, Continuation* next_bb) {
+        fn->param(0)->emit(cg, index);
+        fn->params().back()->emit(cg, next_bb);
+        if (fn->body()->remit(cg))
+            cg.cur_bb->jump(next_bb, { cg.cur_mem }, fn->body()->loc().anew_finis());
+    }, map_expr->loc());
+    cg.cur_bb->jump(break_bb, { cg.cur_mem }, loc().anew_finis());
+
+    cg.enter(break_bb, break_bb->param(0));
+    return cg.world.tuple({}, loc());
+}
+
 const Def* FnExpr::remit(CodeGen& cg) const {
     auto continuation = fn_emit_head(cg, loc());
     fn_emit_body(cg, loc());
@@ -957,7 +1930,7 @@ const Def* FnExpr::remit(CodeGen& cg) const {
  */
 
 void IdPtrn::emit(CodeGen& cg, const thorin::Def* init) const {
-    init->set_name(local()->symbol().str());
+    cg.set_name(init, local()->symbol());
     local()->emit(cg, init);
 }
 
@@ -967,17 +1940,20 @@ const thorin::Def* IdPtrn::emit_cond(CodeGen& cg, const thorin::Def*) const {
 
 void EnumPtrn::emit(CodeGen& cg, const thorin::Def* init) const {
     if (num_args() == 0) return;
-    auto index = path()->decl()->as<OptionDecl>()->index();
-    auto val = cg.world.variant_extract(init, index, loc());
+    auto option_decl = path()->decl()->as<OptionDecl>();
+    auto enum_type = option_decl->enum_decl()->type()->as<EnumType>();
+    auto val = cg.enum_payload(enum_type, init, option_decl->index(), loc());
     for (size_t i = 0, e = num_args(); i != e; ++i)
         arg(i)->emit(cg, num_args() == 1 ? val : cg.world.extract(val, i, loc()));
 }
 
 const thorin::Def* EnumPtrn::emit_cond(CodeGen& cg, const thorin::Def* init) const {
-    auto index = path()->decl()->as<OptionDecl>()->index();
-    auto cond = cg.world.cmp_eq(cg.world.variant_index(init, loc()), cg.world.literal_qu64(index, loc()));
+    auto option_decl = path()->decl()->as<OptionDecl>();
+    auto enum_type = option_decl->enum_decl()->type()->as<EnumType>();
+    auto index = option_decl->index();
+    auto cond = cg.enum_cond(enum_type, init, index, loc());
     if (num_args() > 0) {
-        auto val = cg.world.variant_extract(init, index, loc());
+        auto val = cg.enum_payload(enum_type, init, index, loc());
         for (size_t i = 0, e = num_args(); i != e; ++i) {
             if (!arg(i)->is_refutable()) continue;
             auto arg_cond = arg(i)->emit_cond(cg, num_args() == 1 ? val : cg.world.extract(val, i, loc()));
@@ -1031,7 +2007,44 @@ const thorin::Def* CharPtrn::emit_cond(CodeGen& cg, const thorin::Def* init) con
 void ExprStmt::emit(CodeGen& cg) const { expr()->remit(cg); }
 void ItemStmt::emit(CodeGen& cg) const { item()->emit(cg); }
 
+/// Rough size of @p type in bytes saturated at @p limit + 1 - indefinite arrays never fit.
+static uint64_t frame_size(const Type* type, uint64_t limit) {
+    auto mul = [&] (uint64_t dim, uint64_t size) { return size != 0 && dim > limit / size ? limit + 1 : dim * size; };
+
+    if (type->isa<IndefiniteArrayType>())
+        return limit + 1;
+    if (auto array_type = type->isa<DefiniteArrayType>())
+        return mul(array_type->dim(), frame_size(array_type->elem_type(), limit));
+    if (auto simd_type = type->isa<SimdType>())
+        return mul(simd_type->dim(), frame_size(simd_type->elem_type(), limit));
+    if (type->isa<StructType>() || type->isa<TupleType>()) {
+        uint64_t size = 0;
+        for (size_t i = 0, e = type->num_ops(); i != e; ++i)
+            size = std::min(size + frame_size(type->op(i), limit), limit + 1);
+        return size;
+    }
+    return 8;
+}
+
 void LetStmt::emit(CodeGen& cg) const {
+    // an owned allocation which never leaves its local lives in the current frame instead of on the heap
+    if (auto id_ptrn = ptrn()->isa<IdPtrn>()) {
+        auto prefix_expr = init() ? init()->isa<PrefixExpr>() : nullptr;
+        const uint64_t max_frame_alloc = 64 * 1024;
+        if (prefix_expr && prefix_expr->tag() == PrefixExpr::TILDE && !id_ptrn->local()->is_escaping()
+                && frame_size(cg.instantiate(prefix_expr->rhs()->type()), max_frame_alloc) <= max_frame_alloc) {
+            auto slot = cg.world.slot(cg.convert(prefix_expr->rhs()->type()), cg.frame(), prefix_expr->loc());
+            cg.store_init(prefix_expr->rhs(), slot);
+            ptrn()->emit(cg, slot);
+            return;
+        }
+
+        if (init() && id_ptrn->local()->is_mut() && large_repeated_array(init())) {
+            id_ptrn->local()->emit_init(cg, init());
+            return;
+        }
+    }
+
     ptrn()->emit(cg, init() ? init()->remit(cg) : cg.world.bottom(cg.convert(ptrn()->type()), ptrn()->loc()));
 }
 
@@ -1065,9 +2078,237 @@ void AsmStmt::emit(CodeGen& cg) const {
 
 //------------------------------------------------------------------------------
 
-void emit(World& world, const Module* mod) {
-    CodeGen cg(world);
+/*
+ * intrinsics
+ */
+
+static const thorin::Type* string_type(World& world) {
+    return world.ptr_type(world.indefinite_array_type(world.type_pu8()));
+}
+
+/// Lowers to a call of the Thorin intrinsic @p name whose type @p fn_type derives from the call site.
+static IntrinsicLowering thorin_intrinsic(const char* name, std::function<const thorin::FnType*(IntrinsicCall&)> fn_type) {
+    return [=] (IntrinsicCall& call) -> const Def* {
+        call.callee = call.world.continuation(fn_type(call), {name, call.loc});
+        call.callee->set_intrinsic();
+        return nullptr;
+    };
+}
+
+/**
+ * Lowers to @c llvm.vector.reduce.<op> with the operation @p sop, @p uop or @p fop for vectors of signed, unsigned or float lanes.
+ * Float sums and products are ordered like a loop over the lanes and start with the neutral element.
+ */
+/// The SIMD builtins lowered to LLVM intrinsics are only understood by the LLVM CPU backend - see @p EmitOptions::llvm_cpu.
+static bool llvm_cpu_only(IntrinsicCall& call) {
+    if (call.cg.opts.llvm_cpu)
+        return true;
+    error(call.loc, "SIMD reductions, masked accesses, gathers and scatters are only supported by the LLVM CPU backend (-emit-llvm, -emit-bc or -emit-obj without -emit-c)");
+    return false;
+}
+
+static IntrinsicLowering reduction(const char* sop, const char* uop, const char* fop = nullptr) {
+    return [=] (IntrinsicCall& call) -> const Def* {
+        auto& w = call.world;
+        auto l = call.loc;
+        if (!llvm_cpu_only(call))
+            return w.bottom(call.type, l);
+        auto vec_type = call.cg.instantiate(call.expr->arg(0)->type())->as<SimdType>();
+        auto elem_type = vec_type->elem_type();
+        auto op = is_float(elem_type) ? fop : is_i8(elem_type) || is_i16(elem_type) || is_i32(elem_type) || is_i64(elem_type) ? sop : uop;
+        assert(op && "no reduction of float vectors with this operation");
+
+        std::vector<const Def*> args;
+        if (op == std::string("fadd"))
+            args.push_back(w.convert(call.type, w.literal_qf64(-0.0, l), l));
+        else if (op == std::string("fmul"))
+            args.push_back(w.convert(call.type, w.literal_qf64(1.0, l), l));
+        args.push_back(call.args[0]);
+        return call.cg.call_llvm(std::string("llvm.vector.reduce.") + op + "." + call.cg.llvm_mangle(vec_type), args, call.type, l);
+    };
+}
+
+/**
+ * Lowers masked_load(ptr, mask, vec) and masked_store(ptr, mask, vec) to @c llvm.masked.load and @c llvm.masked.store of the vector at @c ptr;
+ * gather(ptr, idx, mask) and scatter(ptr, idx, vec, mask) to @c llvm.masked.gather and @c llvm.masked.scatter of the elements <tt>ptr[idx[i]]</tt>.
+ */
+static IntrinsicLowering masked_access(bool load, bool indexed) {
+    return [=] (IntrinsicCall& call) -> const Def* {
+        auto& cg = call.cg;
+        auto& w = call.world;
+        auto l = call.loc;
+        if (!llvm_cpu_only(call))
+            return load ? w.bottom(call.type, l) : w.tuple({}, l);
+        auto ptr_type = cg.instantiate(call.expr->arg(0)->type())->as<PtrType>();
+        auto vec_type = cg.instantiate(load && indexed ? call.expr->type() : call.expr->arg(2)->type())->as<SimdType>();
+        auto mask = call.args[indexed ? (load ? 2 : 3) : 1];
+        // LLVM takes the alignment as immediate i32; the pointer is only known to be aligned for the lanes
+        auto align = w.literal_qs32(cg.llvm_align(vec_type->elem_type()), l);
+
+        const Def* ptrs;
+        std::string name;
+        if (indexed) {
+            Array<const Def*> lanes(vec_type->dim());
+            for (uint64_t i = 0, e = lanes.size(); i != e; ++i)
+                lanes[i] = w.lea(call.args[0], w.extract(call.args[1], w.literal_qu32(i, l), l), l);
+            ptrs = w.vector(lanes, l);
+            name = std::string("llvm.masked.") + (load ? "gather." : "scatter.") + cg.llvm_mangle(vec_type) + ".v"
+                 + std::to_string(vec_type->dim()) + cg.llvm_mangle_ptr(vec_type->elem_type(), ptr_type->addr_space());
+        } else {
+            ptrs = w.bitcast(w.ptr_type(cg.convert(vec_type), 1, -1, thorin::AddrSpace(ptr_type->addr_space())), call.args[0], l);
+            name = std::string("llvm.masked.") + (load ? "load." : "store.") + cg.llvm_mangle(vec_type) + "."
+                 + cg.llvm_mangle_ptr(vec_type, ptr_type->addr_space());
+        }
+
+        if (load)
+            return cg.call_llvm(name, { ptrs, align, mask, indexed ? w.bottom(call.type, l) : call.args[2] }, call.type, l);
+        cg.call_llvm(name, { call.args[2], ptrs, align, mask }, nullptr, l);
+        return w.tuple({}, l);
+    };
+}
+
+static IntrinsicLowering cmpxchg(const char* name) {
+    return thorin_intrinsic(name, [] (IntrinsicCall& call) {
+        auto& w = call.world;
+        auto ptr_type = call.args[0]->type();
+        auto poly_type = ptr_type->as<thorin::PtrType>()->pointee();
+        return w.fn_type({
+            w.mem_type(), ptr_type, poly_type, poly_type, w.type_pu32(), w.type_pu32(), string_type(w),
+            w.fn_type({ w.mem_type(), poly_type, w.type_bool() }) });
+    });
+}
+
+struct IntrinsicRegistry {
+    std::vector<IntrinsicInfo> infos;
+    std::unordered_map<std::string, Intrinsic> ids;
+};
+
+static IntrinsicRegistry& intrinsics() {
+    static IntrinsicRegistry registry = [] {
+        typedef IntrinsicCall& C;
+        IntrinsicRegistry r;
+        r.infos = {
+            { "",               [] (C) -> const Def* { THORIN_UNREACHABLE; } },
+            { "alignof",        [] (C c) { return c.world.align_of(c.type_args[0], c.loc); } },
+            { "bitcast",        [] (C c) { return c.world.bitcast(c.type_args[0], c.args[0], c.loc); } },
+            { "insert",         [] (C c) { return c.world.insert(c.args[0], c.args[1], c.args[2], c.loc); } },
+            { "select",         [] (C c) { return c.world.select(c.args[0], c.args[1], c.args[2], c.loc); } },
+            { "sizeof",         [] (C c) { return c.world.size_of(c.type_args[0], c.loc); } },
+            { "undef",          [] (C c) { return c.world.bottom(c.type_args[0], c.loc); } },
+            { "reserve_shared", thorin_intrinsic("reserve_shared", [] (C c) {
+                auto& w = c.world;
+                return w.fn_type({ w.mem_type(), w.type_qs32(), w.fn_type({ w.mem_type(), c.type }) });
+            }) },
+            { "atomic",         thorin_intrinsic("atomic", [] (C c) {
+                auto& w = c.world;
+                return w.fn_type({
+                    w.mem_type(), w.type_pu32(), c.args[1]->type(), c.type, w.type_pu32(), string_type(w),
+                    w.fn_type({ w.mem_type(), c.type }) });
+            }) },
+            { "atomic_load",    thorin_intrinsic("atomic_load", [] (C c) {
+                auto& w = c.world;
+                auto ptr_type = c.args[0]->type();
+                return w.fn_type({
+                    w.mem_type(), ptr_type, w.type_pu32(), string_type(w),
+                    w.fn_type({ w.mem_type(), ptr_type->as<thorin::PtrType>()->pointee() }) });
+            }) },
+            { "atomic_store",   thorin_intrinsic("atomic_store", [] (C c) {
+                auto& w = c.world;
+                auto ptr_type = c.args[0]->type();
+                return w.fn_type({
+                    w.mem_type(), ptr_type, ptr_type->as<thorin::PtrType>()->pointee(), w.type_pu32(), string_type(w),
+                    w.fn_type({ w.mem_type() }) });
+            }) },
+            { "cmpxchg",        cmpxchg("cmpxchg") },
+            { "cmpxchg_weak",   cmpxchg("cmpxchg_weak") },
+            { "pe_info",        thorin_intrinsic("pe_info", [] (C c) {
+                auto& w = c.world;
+                return w.fn_type({ w.mem_type(), string_type(w), c.args[1]->type(), w.fn_type({ w.mem_type() }) });
+            }) },
+            { "pe_known",       thorin_intrinsic("pe_known", [] (C c) {
+                auto& w = c.world;
+                return w.fn_type({ w.mem_type(), c.args[0]->type(), w.fn_type({ w.mem_type(), w.type_bool() }) });
+            }) },
+            { "shuffle",        [] (C c) {
+                auto dim = c.cg.dim(c.expr->arg(0)->type());
+                return c.cg.shuffle(c.args[0], c.args[1], c.args[2], dim, c.loc);
+            } },
+            { "reduce_add",     reduction("add", "add", "fadd") },
+            { "reduce_mul",     reduction("mul", "mul", "fmul") },
+            { "reduce_min",     reduction("smin", "umin", "fmin") },
+            { "reduce_max",     reduction("smax", "umax", "fmax") },
+            { "reduce_and",     reduction("and", "and") },
+            { "reduce_or",      reduction("or", "or") },
+            { "reduce_xor",     reduction("xor", "xor") },
+            { "any",            reduction("or", "or") },
+            { "all",            reduction("and", "and") },
+            { "masked_load",    masked_access(true,  false) },
+            { "masked_store",   masked_access(false, false) },
+            { "gather",         masked_access(true,  true) },
+            { "scatter",        masked_access(false, true) },
+        };
+        assert(r.infos.size() == size_t(Intrinsic::Num));
+        for (size_t i = 1, e = r.infos.size(); i != e; ++i)
+            r.ids.emplace(r.infos[i].name, Intrinsic(i));
+        return r;
+    }();
+    return registry;
+}
+
+Intrinsic find_intrinsic(const std::string& name) {
+    auto& ids = intrinsics().ids;
+    auto i = ids.find(name);
+    return i != ids.end() ? i->second : Intrinsic::None;
+}
+
+const IntrinsicInfo& intrinsic_info(Intrinsic intrinsic) { return intrinsics().infos[size_t(intrinsic)]; }
+
+Intrinsic register_intrinsic(const std::string& name, IntrinsicLowering lower) {
+    auto& r = intrinsics();
+    auto id = find_intrinsic(name);
+    if (id == Intrinsic::None) {
+        id = Intrinsic(r.infos.size());
+        r.infos.push_back({ name, nullptr });
+        r.ids.emplace(name, id);
+    }
+    r.infos[size_t(id)].lower = std::move(lower);
+    return id;
+}
+
+//------------------------------------------------------------------------------
+
+void emit(World& world, const Module* mod, const EmitOptions& opts) {
+    CodeGen cg(world, opts);
     mod->emit(cg);
+    cg.emit_pending_specializations();
+    cg.emit_profile_table();
+    cg.write_trace_table();
+}
+
+void count_specializations(World& world, std::vector<PEFilter>& filters) {
+    std::unordered_map<std::string, PEFilter*> where2filter;
+    for (auto& filter : filters) {
+        filter.num_specializations = filter.num_defs = 0;
+        where2filter.emplace(filter.where, &filter);
+    }
+
+    // specialized copies keep the debug info of the function they were made from
+    std::unordered_map<PEFilter*, size_t> num_copies;
+    for (auto continuation : world.copy_continuations()) {
+        if (!continuation->has_body())
+            continue;
+        std::ostringstream where_os;
+        Stream(where_os).fmt("{}", continuation->debug().loc);
+        auto i = where2filter.find(where_os.str());
+        if (i == where2filter.end())
+            continue;
+        ++num_copies[i->second];
+        i->second->num_defs += thorin::Scope(continuation).defs().size();
+    }
+
+    // the first copy stands for the function itself
+    for (auto& p : num_copies)
+        p.first->num_specializations = p.second - 1;
 }
 
 //------------------------------------------------------------------------------
@@ -12,10 +12,14 @@ namespace impala {
 int global_num_warnings = 0;
 int global_num_errors = 0;
 bool fancy_output = false;
+DiagnosticHandler global_diagnostic_handler;
+Index* global_index = nullptr;
 
 bool& fancy() { return fancy_output; }
 int& num_warnings() { return global_num_warnings; }
 int& num_errors() { return global_num_errors; }
+DiagnosticHandler& diagnostic_handler() { return global_diagnostic_handler; }
+Index*& index() { return global_index; }
 
 void init() {
     PrecTable::init();
@@ -67,8 +71,11 @@ bool compile(
     std::unique_ptr<impala::TypeTable> typetable;
     impala::check(typetable, module.get());
     bool result = impala::num_errors() == 0;
-    if (result)
-        impala::emit(world, module.get());
+    if (result) {
+        impala::EmitOptions opts;
+        opts.names = false;
+        impala::emit(world, module.get(), opts);
+    }
 
     return result;
 }
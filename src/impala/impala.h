@@ -1,9 +1,13 @@
 #ifndef IMPALA_IMPALA_H
 #define IMPALA_IMPALA_H
 
+#include <deque>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <sstream>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 #include "thorin/world.h"
@@ -15,18 +19,120 @@
 namespace impala {
 
 class ASTNode;
+class Decl;
+class Expr;
+class FnDecl;
 class Item;
 class Module;
 typedef std::vector<std::unique_ptr<const Item>> Items;
 
 void init();
-void parse(Items&, std::istream&, const char*);
+/// Parses @p is into @p items; @p begin is the position of the first character of @p is within @p filename.
+void parse(Items&, std::istream&, const char*, Pos begin = {1, 1});
 void name_analysis(const Module*);
 void type_inference(std::unique_ptr<TypeTable>& typetable, const Module*);
 void type_analysis(const Module*);
 //void borrow_check(const ModContents*);
 void check(std::unique_ptr<TypeTable>& typetable, const Module*);
-void emit(thorin::World&, const Module*);
+
+/// Records the results of semantic analysis needed by tools like the language server.
+struct Index {
+    std::vector<std::pair<Loc, const Decl*>> uses; ///< filled by name analysis
+    std::vector<const Expr*> exprs;                ///< filled by type analysis
+};
+
+/// If set, semantic analysis records into this @p Index.
+Index*& index();
+
+/// A function whose specialization is controlled by a partial evaluation filter or requested by @c @@ calls.
+struct PEFilter {
+    std::string name;
+    std::string where;                        ///< source location - identifies the filter across compilations
+    size_t num_specializations = 0;           ///< copies beyond the first; set by @p count_specializations
+    size_t num_defs = 0;                      ///< Defs within all copies; set by @p count_specializations
+};
+
+/// Rules of the C ABI of 64 bit targets for passing aggregates.
+enum class CABI {
+    SysV,    ///< System V x86-64 and AArch64: structs and tuples larger than 16 bytes are passed by reference
+    Win64,   ///< Windows x64: structs and tuples are passed by reference unless they have 1, 2, 4 or 8 bytes
+    Unknown, ///< all other targets, such as 32 bit ones: no structs or tuples may cross C ABI boundaries
+};
+
+/// Options for @p emit.
+struct EmitOptions {
+    /// Count executions of function entries, branch targets, @c match arms and loop back edges in a counter per site;
+    /// the first function to run registers the counters with @c __impala_profile_register.
+    bool profile_generate = false;
+    /// Profile written by a @p profile_generate build; orders the targets of multi-way branches by frequency
+    /// and hints the probabilities of @c match arms to LLVM via @c llvm.expect.with.probability if @p llvm_cpu is set.
+    std::string profile_use;
+    /// Report entry and exit of each function declaration via @c __impala_trace_enter and @c __impala_trace_exit.
+    bool instrument_functions = false;
+    /// Only instrument functions with one of these names or declared in one of these files; all if empty.
+    /// Functions exported to C are only instrumented if they are named here.
+    std::vector<std::string> instrument_filter;
+    /// File receiving the table which maps trace ids to function names and locations.
+    std::string trace_table;
+    /// Appended to the names of exported functions - used for the variants of @c -multiversion.
+    std::string export_suffix;
+    /// Make @c main external.
+    bool export_main = true;
+    /// Filters (by @p PEFilter::where) which are replaced by @c false - used to enforce specialization budgets.
+    std::vector<std::string> pe_disabled;
+    /// Receives all functions with partial evaluation filters if set.
+    std::vector<PEFilter>* pe_filters = nullptr;
+    /// Name params, locals and continuations after the source program; only helps reading Thorin dumps and debug info.
+    bool names = true;
+    /// The functions declared by the interface of the module, which are made external - see @p generate_interface.
+    std::unordered_set<const FnDecl*> export_items;
+    /// Decides which structs and tuples cross C ABI boundaries through pointers - see @p is_c_indirect.
+    CABI c_abi = CABI::SysV;
+    /// The LLVM backend predates opaque pointers - the SIMD builtins then name the pointee in the LLVM intrinsics they call.
+    bool typed_pointers = false;
+    /// Only the LLVM CPU backend consumes the code: the SIMD builtins and the hints of @p profile_use may call LLVM intrinsics.
+    /// Kernels for the device backends are emitted into the same module and must not use the SIMD builtins either way;
+    /// the hints of @p profile_use are placed in kernels just as well, which main hence rejects.
+    bool llvm_cpu = false;
+};
+
+/**
+ * Whether a parameter or result of @p type is passed through a pointer by exported functions and their declarations
+ * in @c extern blocks without ABI - like in module interfaces - and hence in headers from @c -emit-c-interface:
+ * definite arrays like in C as well as structs, tuples and the @c struct @c S_soa of <tt>&[S]</tt> which the rules of @p abi
+ * pass by reference.
+ * Indirect results are written to a pointer passed before all other arguments.
+ * Functions of @c extern @c "C" blocks take and return all values as they are.
+ */
+bool is_c_indirect(const Type*, CABI abi);
+
+/// Reports an error and returns @c false if @p fn passes structs or tuples across the C ABI although @p abi is @c CABI::Unknown.
+bool check_c_abi(const FnDecl* fn, CABI abi);
+
+void emit(thorin::World&, const Module*, const EmitOptions& = EmitOptions());
+
+/**
+ * Streams the interface of a module consisting of @p items: an Impala source file which importers load via @c mod.
+ * It contains all types, traits, impls, extern blocks and @c mod declarations as they are
+ * and copies functions with @p FnDecl::is_inline; all other functions are merely declared.
+ * @c priv items, statics and inline modules are left out - except for the @c priv functions the copied ones use,
+ * which are declared or copied as well; statics they use are reported as errors.
+ * Call this before semantic analysis since the types it infers are not valid Impala syntax.
+ * @return The declared functions, which the module has to export - see @p EmitOptions::export_items.
+ */
+std::unordered_set<const FnDecl*> generate_interface(const Items& items, std::ostream&);
+/**
+ * Appends the items of the interface @c name.impi of each module declared by @c mod @c name; to @p items.
+ * The first of @p paths which contains it wins; imports of the loaded interfaces are followed as well.
+ * The names of the loaded files are appended to @p file_names which must outlive the Locs of the loaded items.
+ */
+void load_interfaces(Items& items, const std::vector<std::string>& paths, std::deque<std::string>& file_names);
+/**
+ * Counts the copies of each function in @p filters that partial evaluation left in @p world.
+ * Copies are attributed by the source location in their debug info and the first one is taken for the original.
+ * Hence, a function which is inlined into all of its callers is reported with one specialization less than it has.
+ */
+void count_specializations(thorin::World&, std::vector<PEFilter>& filters);
 
 enum class Prec {
     Bottom,
@@ -55,9 +161,18 @@ int& num_warnings();
 int& num_errors();
 bool& fancy();
 
+/// Receives warnings (@p error is @c false) and errors instead of @c std::cerr if set.
+typedef std::function<void(const Loc&, bool error, const std::string&)> DiagnosticHandler;
+DiagnosticHandler& diagnostic_handler();
+
 template<class... Args>
 void warning(const Loc& loc, const char* fmt, Args... args) {
     ++num_warnings();
+    if (auto& handler = diagnostic_handler()) {
+        std::ostringstream os;
+        Stream(os).fmt(fmt, std::forward<Args>(args)...);
+        return handler(loc, false, os.str());
+    }
     Stream s(std::cerr);
     s.fmt("{}: warning: ", loc).fmt(fmt, std::forward<Args>(args)...).endl();
 }
@@ -65,6 +180,11 @@ void warning(const Loc& loc, const char* fmt, Args... args) {
 template<class... Args>
 void error(const Loc& loc, const char* fmt, Args... args) {
     ++num_errors();
+    if (auto& handler = diagnostic_handler()) {
+        std::ostringstream os;
+        Stream(os).fmt(fmt, std::forward<Args>(args)...);
+        return handler(loc, true, os.str());
+    }
     Stream s(std::cerr);
     s.fmt("{}: error: ", loc).fmt(fmt, std::forward<Args>(args)...).endl();
 }
@@ -0,0 +1,114 @@
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "impala/ast.h"
+#include "impala/impala.h"
+
+namespace impala {
+
+/// Function which the interface of its module declares rather than copies - unless an inline function calls it, priv ones are left out.
+static bool is_interface_decl(const FnDecl* fn_decl) {
+    return fn_decl->body() && !fn_decl->is_inline() && fn_decl->symbol() != "main";
+}
+
+/// The identifiers in @p fn_decl - a superset of the names of the items it uses, which are not resolved yet.
+static std::unordered_set<std::string> identifiers(const FnDecl* fn_decl) {
+    std::ostringstream os;
+    Stream s(os);
+    fn_decl->stream(s);
+    auto src = os.str();
+
+    std::unordered_set<std::string> ids;
+    for (size_t i = 0, e = src.size(); i != e;) {
+        size_t j = i;
+        while (j != e && (std::isalnum(src[j]) || src[j] == '_'))
+            ++j;
+        if (j != i && !std::isdigit(src[i]))
+            ids.emplace(src.substr(i, j - i));
+        i = j != i ? j : i + 1;
+    }
+    return ids;
+}
+
+std::unordered_set<const FnDecl*> generate_interface(const Items& items, std::ostream& o) {
+    Stream s(o);
+    std::vector<const FnDecl*> decls, copies;
+    // priv functions and all statics - only needed by importers if copied functions use them
+    std::unordered_map<std::string, const ValueItem*> hidden;
+
+    for (auto&& item : items) {
+        auto fn_decl = item->isa<FnDecl>();
+        if (fn_decl && fn_decl->body() && fn_decl->visibility().is_priv())
+            hidden.emplace(fn_decl->symbol().str(), fn_decl);
+        else if (auto static_item = item->isa<StaticItem>())
+            hidden.emplace(static_item->symbol().str(), static_item);
+        else if (item->visibility().is_priv())
+            continue;
+        else if (fn_decl && is_interface_decl(fn_decl))
+            decls.push_back(fn_decl);
+        else if (fn_decl && fn_decl->is_inline())
+            copies.push_back(fn_decl);
+        else if (!fn_decl && !item->isa<Module>())
+            // types, traits, impls, extern blocks and the modules this one imports in turn
+            item->stream(s).endl().endl();
+    }
+
+    // a shadowing local merely declares a priv function needlessly
+    for (size_t i = 0; i != copies.size(); ++i) {
+        for (const auto& id : identifiers(copies[i])) {
+            auto h = hidden.find(id);
+            if (h == hidden.end() || h->second == nullptr)
+                continue;
+            auto item = h->second;
+            h->second = nullptr;
+            if (item->isa<StaticItem>())
+                error(item->loc(), "static '{}' is used by inline function '{}' which the interface of the module copies", id, copies[i]->symbol());
+            else if (item->as<FnDecl>()->is_inline())
+                copies.push_back(item->as<FnDecl>());
+            else
+                decls.push_back(item->as<FnDecl>());
+        }
+        copies[i]->stream(s).endl().endl();
+    }
+
+    // the defining module makes these external when compiled with EmitOptions::export_items
+    if (!decls.empty()) {
+        s.fmt("extern {{\t");
+        for (auto fn_decl : decls)
+            fn_decl->stream_head(s.endl()) << ';';
+        s.fmt("\b\n}}").endl();
+    }
+    return std::unordered_set<const FnDecl*>(decls.begin(), decls.end());
+}
+
+void load_interfaces(Items& items, const std::vector<std::string>& paths, std::deque<std::string>& file_names) {
+    std::unordered_set<std::string> loaded;
+
+    // loaded interfaces are appended to items and may import further modules themselves
+    for (size_t i = 0; i != items.size(); ++i) {
+        auto module_decl = items[i]->isa<ModuleDecl>();
+        if (module_decl == nullptr || !loaded.emplace(module_decl->symbol().str()).second)
+            continue;
+
+        auto name = module_decl->symbol().str() + ".impi";
+        std::ifstream file;
+        for (const auto& path : paths) {
+            file.open(path.empty() ? name : path + "/" + name);
+            if (file) {
+                file_names.push_back(path.empty() ? name : path + "/" + name);
+                break;
+            }
+            file.clear();
+        }
+
+        if (!file.is_open())
+            error(module_decl->loc(), "interface '{}' of module '{}' not found", name, module_decl->symbol());
+        else
+            parse(items, file, file_names.back().c_str());
+    }
+}
+
+}
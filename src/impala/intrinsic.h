@@ -0,0 +1,64 @@
+#ifndef IMPALA_INTRINSIC_H
+#define IMPALA_INTRINSIC_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "thorin/world.h"
+
+namespace impala {
+
+class CodeGen;
+class MapExpr;
+
+/**
+ * Functions of @c extern @c "thorin" blocks which are lowered at each call site instead of being called.
+ * A @p FnDecl resolves its id by name once during name binding; ids of custom intrinsics start at @c Num.
+ */
+enum class Intrinsic : uint32_t {
+    None,
+    // primops
+    AlignOf, Bitcast, Insert, Select, SizeOf, Undef,
+    // Thorin intrinsics whose type depends on the call site
+    ReserveShared, Atomic, AtomicLoad, AtomicStore, CmpXchg, CmpXchgWeak, PeInfo, PeKnown,
+    // SIMD builtins
+    Shuffle, ReduceAdd, ReduceMul, ReduceMin, ReduceMax, ReduceAnd, ReduceOr, ReduceXor, Any, All,
+    MaskedLoad, MaskedStore, Gather, Scatter,
+    Num
+};
+
+/// A call of an intrinsic as seen by its lowering.
+struct IntrinsicCall {
+    CodeGen& cg;                                ///< only complete within emit.cpp
+    thorin::World& world;
+    const MapExpr* expr;
+    std::vector<const thorin::Type*> type_args;
+    std::vector<const thorin::Def*> args;       ///< without mem and return continuation
+    const thorin::Type* type;                   ///< of the result
+    thorin::Loc loc;
+    /// Set by lowerings of intrinsics Thorin implements itself; called with mem, @p args and a return continuation.
+    thorin::Continuation* callee = nullptr;
+};
+
+/// Returns the result of @p call - or @c nullptr after setting @p IntrinsicCall::callee.
+typedef std::function<const thorin::Def*(IntrinsicCall& call)> IntrinsicLowering;
+
+struct IntrinsicInfo {
+    std::string name;
+    IntrinsicLowering lower;
+};
+
+/// Id of the intrinsic called @p name or @c Intrinsic::None.
+Intrinsic find_intrinsic(const std::string& name);
+const IntrinsicInfo& intrinsic_info(Intrinsic);
+/**
+ * Lowers calls of the @c extern @c "thorin" function @p name via @p lower from now on.
+ * Replaces the lowering of a builtin intrinsic of the same name; otherwise allocates a new id.
+ */
+Intrinsic register_intrinsic(const std::string& name, IntrinsicLowering lower);
+
+}
+
+#endif
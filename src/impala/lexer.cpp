@@ -20,10 +20,10 @@ static inline bool hex(int c) { return std::isxdigit(c) != 0; }
 static inline bool eE(int c) { return c == 'e' || c == 'E'; }
 static inline bool sgn(int c){ return c == '+' || c == '-'; }
 
-Lexer::Lexer(std::istream& stream, const char* filename)
+Lexer::Lexer(std::istream& stream, const char* filename, Pos begin)
     : stream_(stream)
-    , loc_(filename, {1, 1})
-    , peek_({1, 1})
+    , loc_(filename, begin)
+    , peek_(begin)
 {
     if (!stream_)
         throw std::runtime_error("stream is bad");
@@ -11,7 +11,7 @@ namespace impala {
 
 class Lexer {
 public:
-    Lexer(std::istream& stream, const char* filename);
+    Lexer(std::istream& stream, const char* filename, Pos begin = {1, 1});
 
     Token lex(); ///< Get next \p Token in stream.
 
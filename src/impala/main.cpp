@@ -1,12 +1,51 @@
+#include <algorithm>
+#include <deque>
 #include <fstream>
+#include <sstream>
+#include <unordered_map>
 #include <vector>
 #include <cctype>
 #include <stdexcept>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
 
 #include "thorin/be/codegen.h"
 #include "thorin/be/c/c.h"
 #ifdef LLVM_SUPPORT
 #include "thorin/be/llvm/cpu.h"
+
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Module.h>
+#if LLVM_VERSION_MAJOR >= 14
+#include <llvm/MC/TargetRegistry.h>
+#else
+#include <llvm/Support/TargetRegistry.h>
+#endif
+#include <llvm/Support/Error.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#if LLVM_VERSION_MAJOR >= 17
+#include <llvm/TargetParser/Host.h>
+#include <llvm/TargetParser/Triple.h>
+#else
+#include <llvm/ADT/Triple.h>
+#include <llvm/Support/Host.h>
+#endif
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Transforms/Scalar/LowerExpectIntrinsic.h>
+#include <llvm/Transforms/Utils/SplitModule.h>
 #endif
 
 #include "impala/ast.h"
@@ -29,23 +68,208 @@ std::ostream* open(std::ofstream& stream, const std::string& name) {
     return &stream;
 }
 
+/// Peak resident set size of this process in KiB or 0 if unknown.
+static long peak_rss() {
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+#ifdef __APPLE__
+        return usage.ru_maxrss / 1024; // bytes on macOS
+#else
+        return usage.ru_maxrss;
+#endif
+#endif
+    return 0;
+}
+
+/// Writes @p content to @p name unless the file already contains it - keeps dependents of unchanged interfaces up to date.
+static void write_if_changed(const std::string& name, const std::string& content) {
+    {
+        std::ifstream in(name);
+        std::ostringstream old;
+        old << in.rdbuf();
+        if (in && old.str() == content)
+            return;
+    }
+
+    std::ofstream out(name);
+    if (!out)
+        throw std::runtime_error("cannot write '" + name + "': " + strerror(errno));
+    out << content;
+}
+
+#ifdef LLVM_SUPPORT
+/// Turns the calls of @c llvm.expect.with.probability into branch weights - the legacy pass of LLVM < 17 is gone in newer versions.
+static void lower_expect(llvm::Module& module, llvm::TargetMachine& machine) {
+    llvm::LoopAnalysisManager lam;
+    llvm::FunctionAnalysisManager fam;
+    llvm::CGSCCAnalysisManager cgam;
+    llvm::ModuleAnalysisManager mam;
+    llvm::PassBuilder builder(&machine);
+    builder.registerModuleAnalyses(mam);
+    builder.registerCGSCCAnalyses(cgam);
+    builder.registerFunctionAnalyses(fam);
+    builder.registerLoopAnalyses(lam);
+    builder.crossRegisterProxies(lam, fam, cgam, mam);
+
+    llvm::ModulePassManager mpm;
+    mpm.addPass(llvm::createModuleToFunctionPassAdaptor(llvm::LowerExpectIntrinsicPass()));
+    mpm.run(module, mam);
+}
+
+/// Writes @p module as bitcode or - if @p obj is set - as native object without going through textual IR.
+static void write_llvm_module(llvm::Module& module, const std::string& name, bool obj, int opt,
+                              const std::string& cpu, const std::string& attr) {
+    std::error_code ec;
+    llvm::raw_fd_ostream out(name, ec, llvm::sys::fs::OF_None);
+    if (ec)
+        throw std::runtime_error("cannot write '" + name + "': " + ec.message());
+
+    if (!obj) {
+        llvm::WriteBitcodeToFile(module, out);
+        return;
+    }
+
+    auto triple = module.getTargetTriple();
+    if (triple.empty())
+        triple = llvm::sys::getDefaultTargetTriple();
+    std::string error;
+    auto target = llvm::TargetRegistry::lookupTarget(triple, error);
+    if (target == nullptr)
+        throw std::runtime_error("cannot emit object code for '" + triple + "': " + error);
+
+#if LLVM_VERSION_MAJOR >= 18
+    auto level = opt == 0 ? llvm::CodeGenOptLevel::None : opt == 3 ? llvm::CodeGenOptLevel::Aggressive : llvm::CodeGenOptLevel::Default;
+    auto file_type = llvm::CodeGenFileType::ObjectFile;
+#else
+    auto level = opt == 0 ? llvm::CodeGenOpt::None : opt == 3 ? llvm::CodeGenOpt::Aggressive : llvm::CodeGenOpt::Default;
+    auto file_type = llvm::CGFT_ObjectFile;
+#endif
+    std::unique_ptr<llvm::TargetMachine> machine(target->createTargetMachine(
+        triple, cpu.empty() ? llvm::sys::getHostCPUName().str() : cpu, attr, llvm::TargetOptions(), llvm::Reloc::PIC_, {}, level));
+    module.setDataLayout(machine->createDataLayout());
+
+    // the -fprofile-use hints reach the switches and branches only after Thorin's optimizations have removed the phis in between
+    lower_expect(module, *machine);
+
+    llvm::legacy::PassManager pm;
+    if (machine->addPassesToEmitFile(pm, out, nullptr, file_type))
+        throw std::runtime_error("target '" + triple + "' cannot emit object files");
+    pm.run(module);
+}
+
+/**
+ * Writes the module of @p cg to @p name + @p ext - or splits it along function boundaries into @p num_units
+ * modules written to @p name.i + @p ext, which are lowered to objects in parallel.
+ */
+static void emit_llvm_binary(thorin::llvm::CPUCodeGen& cg, const std::string& name, const std::string& ext, bool obj, int opt,
+                             const std::string& cpu, const std::string& attr, size_t num_units) {
+    if (obj) {
+        llvm::InitializeAllTargetInfos();
+        llvm::InitializeAllTargets();
+        llvm::InitializeAllTargetMCs();
+        llvm::InitializeAllAsmPrinters();
+    }
+
+    // the module belongs to the context of cg
+    auto&& module = cg.emit_module();
+    if (num_units <= 1)
+        return write_llvm_module(*module, name + ext, obj, opt, cpu, attr);
+
+    // contexts must not be shared between threads - so each unit travels as bitcode into a context of its own
+    std::vector<llvm::SmallString<0>> units;
+    auto split = [&] (std::unique_ptr<llvm::Module> unit) {
+        units.emplace_back();
+        llvm::raw_svector_ostream os(units.back());
+        llvm::WriteBitcodeToFile(*unit, os);
+    };
+    llvm::SplitModule(*module, num_units, split, /*PreserveLocals*/ false);
+
+    std::vector<std::thread> threads;
+    std::vector<std::exception_ptr> errors(units.size());
+    for (size_t i = 0, e = units.size(); i != e; ++i) {
+        threads.emplace_back([&, i] {
+            try {
+                auto unit_name = name + "." + std::to_string(i) + ext;
+                llvm::LLVMContext context;
+                auto unit = llvm::parseBitcodeFile(llvm::MemoryBufferRef(units[i].str(), unit_name), context);
+                if (!unit)
+                    throw std::runtime_error("cannot read back unit '" + unit_name + "': " + llvm::toString(unit.takeError()));
+                write_llvm_module(**unit, unit_name, obj, opt, cpu, attr);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    for (auto& error : errors) {
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
+#endif
+
+/// Filters which exceed their budget - or the most specialized ones if all of them together exceed @p total.
+static std::vector<const impala::PEFilter*> over_budget(const std::vector<impala::PEFilter>& filters, size_t budget, size_t total,
+                                                        const std::unordered_map<std::string, size_t>& fn_budgets) {
+    std::vector<const impala::PEFilter*> result, rest;
+    size_t sum = 0;
+    for (const auto& filter : filters) {
+        auto i = fn_budgets.find(filter.name);
+        auto limit = i != fn_budgets.end() ? i->second : budget;
+        if (limit != 0 && filter.num_specializations > limit) {
+            result.push_back(&filter);
+        } else {
+            rest.push_back(&filter);
+            sum += filter.num_specializations;
+        }
+    }
+
+    if (total != 0 && sum > total) {
+        std::sort(rest.begin(), rest.end(), [] (auto a, auto b) { return a->num_specializations > b->num_specializations; });
+        for (auto filter : rest) {
+            if (sum <= total || filter->num_specializations == 0) break;
+            sum -= filter->num_specializations;
+            result.push_back(filter);
+        }
+    }
+    return result;
+}
+
+/// Writes one line '<loc> <name> <specializations> <defs>' per filter, most specialized first; disabled filters are marked.
+static void write_pe_report(const std::string& name, std::vector<impala::PEFilter> filters, const std::vector<std::string>& disabled) {
+    std::ofstream out(name);
+    if (!out)
+        throw std::runtime_error("cannot write '" + name + "': " + strerror(errno));
+
+    std::stable_sort(filters.begin(), filters.end(), [] (const auto& a, const auto& b) { return a.num_specializations > b.num_specializations; });
+    for (const auto& filter : filters) {
+        out << filter.where << ' ' << filter.name << ' ' << filter.num_specializations << ' ' << filter.num_defs;
+        if (std::find(disabled.begin(), disabled.end(), filter.where) != disabled.end())
+            out << " disabled";
+        out << std::endl;
+    }
+}
+
 int main(int argc, char** argv) {
     try {
         if (argc < 1)
             throw std::logic_error("bad number of arguments");
 
         std::string prgname = argv[0];
-        Names infiles;
+        Names infiles, instrument_filter, multiversion, pe_budget_fn, import_paths;
 #ifndef NDEBUG
         Names breakpoints;
         Names use_breakpoints;
         bool track_history;
 #endif
-        std::string out_name, log_name, log_level, host_triple, host_cpu, host_attr, hls_flags;
+        std::string out_name, log_name, log_level, host_triple, host_cpu, host_attr, hls_flags, profile_use, pe_report;
+        int pe_budget, pe_budget_total, codegen_units;
         bool help,
-             emit_c, emit_cint, emit_thorin, emit_ast, emit_annotated, emit_llvm,
-             opt_thorin, opt_s, opt_0, opt_1, opt_2, opt_3, debug,
-             nocleanup, fancy;
+             emit_c, emit_cint, emit_interface, emit_thorin, emit_ast, emit_annotated, emit_llvm, emit_bc, emit_obj, names,
+             opt_thorin, no_opt_thorin, opt_s, opt_0, opt_1, opt_2, opt_3, debug,
+             nocleanup, fancy, low_mem, print_rss, profile_generate, instrument_functions;
 
 #ifndef NDEBUG
 #define LOG_LEVELS "{error|warn|info|verbose|debug}"
@@ -70,23 +294,51 @@ int main(int argc, char** argv) {
             .add_option<bool>            ("O3",                 "", "optimize yet more", opt_3, false)
             .add_option<bool>            ("Os",                 "", "optimize for size", opt_s, false)
             .add_option<bool>            ("Othorin",            "", "optimize at Thorin level", opt_thorin, false)
+            .add_option<bool>            ("Onothorin",          "", "do not optimize at Thorin level even when emitting code", no_opt_thorin, false)
             .add_option<bool>            ("emit-annotated",     "", "emit AST of Impala program after semantic analysis", emit_annotated, false)
             .add_option<bool>            ("emit-ast",           "", "emit AST of Impala program", emit_ast, false)
             .add_option<bool>            ("emit-c",             "", "emit C from Thorin representation (implies -Othorin)", emit_c, false)
             .add_option<bool>            ("emit-c-interface",   "", "emit C interface from Impala code (experimental)", emit_cint, false)
+            .add_option<bool>            ("emit-interface",     "", "emit the interface of the module for importers and export the functions it declares", emit_interface, false)
             .add_option<bool>            ("emit-llvm",          "", "emit llvm from Thorin representation (implies -Othorin)", emit_llvm, false)
+            .add_option<bool>            ("emit-bc",            "", "emit llvm bitcode instead of textual llvm (implies -Othorin)", emit_bc, false)
+            .add_option<bool>            ("emit-obj",           "", "emit a native object file via llvm (implies -Othorin)", emit_obj, false)
             .add_option<bool>            ("emit-thorin",        "", "emit textual Thorin representation of Impala program", emit_thorin, false)
-            .add_option<std::string>     ("host-triple",        "", "emit llvm target code for the specified target triple", host_triple, "")
+            .add_option<Names>           ("I",                  "<dirs>", "search the given directories for the interfaces of modules imported via 'mod <name>;' after the directory of the first input file", import_paths)
+            .add_option<std::string>     ("host-triple",        "", "emit llvm target code for the specified target triple; only 64 bit targets are supported", host_triple, "")
             .add_option<std::string>     ("host-cpu",           "", "emit llvm target code for the specified cpu type", host_cpu, "")
             .add_option<std::string>     ("host-attr",          "", "emit llvm target code with the specified attributes", host_attr, "")
+            .add_option<int>             ("codegen-units",      "<n>", "split the llvm module along function boundaries into <n> units which are written to <module>.<i>.bc or lowered to <module>.<i>.o in parallel; requires -emit-bc or -emit-obj", codegen_units, 1)
+            .add_option<Names>           ("multiversion",       "<cpu[:attr]...>", "emit one variant of the module per CPU, best first, and a C dispatcher which selects the first whose +attributes are all supported by the x86 CPU it runs on; all but the last target need +attributes known to __builtin_cpu_supports; the last one is the fallback, which is always taken on other architectures such as AArch64, and the only one which exports main, so main always runs the fallback variant", multiversion)
             .add_option<std::string>     ("hls-flags",          "", "emit HLS code for the specified flags", hls_flags, "")
             .add_option<bool>            ("f",                  "", "use fancy output: Impala's AST dump uses only parentheses where necessary", fancy, false)
             .add_option<bool>            ("g",                  "", "emit debug information", debug, false)
-            .add_option<bool>            ("nocleanup",          "", "no clean-up phase", nocleanup, false);
+            .add_option<bool>            ("names",              "", "name the Thorin program after the source program; implied by -g, -emit-thorin and debug builds", names, false)
+            .add_option<bool>            ("fprofile-generate",  "", "count executions of functions, branches, match arms and loop iterations; link with impala_profile_rt", profile_generate, false)
+            .add_option<std::string>     ("fprofile-use",       "<file>", "use a profile written by a -fprofile-generate build to weight the arms of match expressions; the weights only reach the LLVM CPU backend; not supported for programs with device kernels", profile_use, "")
+            .add_option<bool>            ("finstrument-functions", "", "report entry and exit of each function; link with impala_trace_rt to obtain a Chrome trace", instrument_functions, false)
+            .add_option<Names>           ("finstrument-functions-filter", "<args>", "only instrument functions with one of the given names or declared in one of the given files; functions exported to C are only instrumented if named", instrument_filter)
+            .add_option<int>             ("pe-budget",          "<n>", "disable the partial evaluation filter and @@ calls of each function specialized more than <n> times; 0 means no limit; does not bound the memory needed to find out", pe_budget, 0)
+            .add_option<int>             ("pe-budget-total",    "<n>", "disable the most specialized filters until at most <n> specializations remain; 0 means no limit", pe_budget_total, 0)
+            .add_option<Names>           ("pe-budget-fn",       "<name=n...>", "override -pe-budget for the functions with the given names", pe_budget_fn)
+            .add_option<std::string>     ("pe-report",          "<file>", "write the number of specializations and their Defs per partial evaluation filter", pe_report, "")
+            .add_option<bool>            ("nocleanup",          "", "no clean-up phase", nocleanup, false)
+            .add_option<bool>            ("low-mem",            "", "release AST and type tables as soon as Thorin code has been emitted; the front end still holds the whole module at once", low_mem, false)
+            .add_option<bool>            ("print-rss",          "", "print the peak resident set size after the front end and at exit", print_rss, false);
 
         // do cmdline parsing
         cmd_parser.parse(argc, argv);
-        opt_thorin |= emit_llvm | emit_c;
+        // -emit-bc and -emit-obj run llvm in-process instead of writing textual IR for another tool to parse again
+        bool emit_cpu = emit_llvm || emit_bc || emit_obj;
+        if (emit_llvm + emit_bc + emit_obj > 1)
+            throw std::invalid_argument("-emit-llvm, -emit-bc and -emit-obj are mutually exclusive");
+#ifndef LLVM_SUPPORT
+        if (emit_cpu)
+            throw std::invalid_argument("impala was built without llvm support");
+#endif
+        if (codegen_units < 1 || (codegen_units > 1 && !emit_bc && !emit_obj))
+            throw std::invalid_argument("-codegen-units expects a positive number and requires -emit-bc or -emit-obj");
+        opt_thorin = (opt_thorin | emit_cpu | emit_c) && !no_opt_thorin;
 
         impala::fancy() = fancy;
 
@@ -130,135 +382,288 @@ int main(int argc, char** argv) {
             }
         }
 
-        thorin::Thorin thorin(module_name);
-        impala::init();
-
-        std::ofstream log_stream;
-        thorin.world().set(std::make_shared<thorin::Stream>(*open(log_stream, log_name)));
-
-        if (false) {}
-        else if (log_level == "error")   thorin.world().set(thorin::LogLevel::Error);
-        else if (log_level == "warn")    thorin.world().set(thorin::LogLevel::Warn);
-        else if (log_level == "info")    thorin.world().set(thorin::LogLevel::Info);
-        else if (log_level == "verbose") thorin.world().set(thorin::LogLevel::Verbose);
-        else if (log_level == "debug")   thorin.world().set(thorin::LogLevel::Debug);
-        else throw std::invalid_argument("log level must be one of " LOG_LEVELS);
-
-#if THORIN_ENABLE_CHECKS && !defined(NDEBUG)
-        auto set_breakpoints = [&](auto breakpoints, auto setter) {
-            for (auto b : breakpoints) {
-                assert(b.size() > 0);
-                size_t num = 0;
-                for (size_t i = 0, e = b.size(); i != e; ++i) {
-                    char c = b[i];
-                    if (c == '_') {
-                        if (num != 0) {
-                            std::invoke(setter, thorin.world(), num);
-                            num = 0;
+        // the C ABI lowering of aggregates - see impala::is_c_indirect - only knows the rules of 64 bit targets
+#ifdef LLVM_SUPPORT
+        llvm::Triple triple(host_triple.empty() ? llvm::sys::getDefaultTargetTriple() : host_triple);
+        bool known_abi = triple.isArch64Bit();
+        bool windows = triple.isOSWindows();
+#elif defined(_WIN32)
+        bool known_abi = true;
+        bool windows = host_triple.empty() || host_triple.find("windows") != std::string::npos;
+#else
+        bool known_abi = true;
+        bool windows = host_triple.find("windows") != std::string::npos;
+#endif
+        auto c_abi = !known_abi ? impala::CABI::Unknown : windows ? impala::CABI::Win64 : impala::CABI::SysV;
+
+        // -multiversion compiles the module once per target; a C dispatcher selects one of them at runtime
+        std::vector<impala::CPUTarget> targets;
+        for (const auto& t : multiversion) {
+            impala::CPUTarget target;
+            auto colon = t.find(':');
+            target.cpu  = t.substr(0, colon);
+            target.attr = colon == std::string::npos ? "" : t.substr(colon + 1);
+            target.suffix = "__";
+            for (auto c : target.cpu)
+                target.suffix += std::isalnum(c) ? c : '_';
+            // the dispatcher only checks the attributes - a target without any would always be taken
+            bool checked = false;
+            std::istringstream attrs(target.attr);
+            std::string attr;
+            while (std::getline(attrs, attr, ',')) {
+                if (attr.empty() || attr[0] != '+')
+                    continue;
+                if (!impala::is_dispatchable_feature(attr.substr(1)))
+                    throw std::invalid_argument("-multiversion: the dispatcher cannot check attribute '" + attr + "' of target '" + t + "'");
+                checked = true;
+            }
+            if (!checked && targets.size() + 1 != multiversion.size())
+                throw std::invalid_argument("-multiversion: target '" + t + "' needs +attributes to be told apart from the ones after it; only the last target may have none");
+            targets.push_back(target);
+        }
+        if (!multiversion.empty() && (emit_c || !emit_cpu))
+            throw std::invalid_argument("-multiversion requires -emit-llvm, -emit-bc or -emit-obj and cannot be combined with -emit-c");
+        if (targets.empty())
+            targets.push_back({ host_cpu, host_attr, "" });
+
+        // budgets are enforced by compiling again without the filters which exceeded them;
+        // they bound the size of the output but not the peak memory: each attempt specializes to completion first
+        std::unordered_map<std::string, size_t> fn_budgets;
+        for (const auto& b : pe_budget_fn) {
+            auto eq = b.find('=');
+            if (eq == std::string::npos)
+                throw std::invalid_argument("-pe-budget-fn expects <name>=<n>, got '" + b + "'");
+            fn_budgets[b.substr(0, eq)] = std::stoul(b.substr(eq + 1));
+        }
+        bool pe_budgets = pe_budget != 0 || pe_budget_total != 0 || !fn_budgets.empty();
+        std::vector<std::string> pe_disabled;
+        std::vector<impala::PEFilter> pe_filters;
+
+        for (const auto& target : targets) {
+            bool first = &target == &targets.front();
+            auto variant_name = module_name + target.suffix;
+            bool retry;
+            do {
+                retry = false;
+                pe_filters.clear();
+                thorin::Thorin thorin(variant_name);
+                impala::init();
+
+                std::ofstream log_stream;
+                thorin.world().set(std::make_shared<thorin::Stream>(*open(log_stream, log_name)));
+
+                if (false) {}
+                else if (log_level == "error")   thorin.world().set(thorin::LogLevel::Error);
+                else if (log_level == "warn")    thorin.world().set(thorin::LogLevel::Warn);
+                else if (log_level == "info")    thorin.world().set(thorin::LogLevel::Info);
+                else if (log_level == "verbose") thorin.world().set(thorin::LogLevel::Verbose);
+                else if (log_level == "debug")   thorin.world().set(thorin::LogLevel::Debug);
+                else throw std::invalid_argument("log level must be one of " LOG_LEVELS);
+
+        #if THORIN_ENABLE_CHECKS && !defined(NDEBUG)
+                auto set_breakpoints = [&](auto breakpoints, auto setter) {
+                    for (auto b : breakpoints) {
+                        assert(b.size() > 0);
+                        size_t num = 0;
+                        for (size_t i = 0, e = b.size(); i != e; ++i) {
+                            char c = b[i];
+                            if (c == '_') {
+                                if (num != 0) {
+                                    std::invoke(setter, thorin.world(), num);
+                                    num = 0;
+                                }
+                            } else if (std::isdigit(c)) {
+                                num = num*10 + c - '0';
+                            } else {
+                                std::cerr << "invalid breakpoint '" << b << "'" << std::endl;
+                                return false;
+                            }
                         }
-                    } else if (std::isdigit(c)) {
-                        num = num*10 + c - '0';
-                    } else {
-                        std::cerr << "invalid breakpoint '" << b << "'" << std::endl;
-                        return false;
+
+                        if (num != 0) std::invoke(setter, thorin.world(), num);
                     }
-                }
 
-                if (num != 0) std::invoke(setter, thorin.world(), num);
-            }
+                    return true;
+                };
 
-            return true;
-        };
+                if (!set_breakpoints(    breakpoints, &thorin::World::    breakpoint)) return EXIT_FAILURE;
+                if (!set_breakpoints(use_breakpoints, &thorin::World::use_breakpoint)) return EXIT_FAILURE;
 
-        if (!set_breakpoints(    breakpoints, &thorin::World::    breakpoint)) return EXIT_FAILURE;
-        if (!set_breakpoints(use_breakpoints, &thorin::World::use_breakpoint)) return EXIT_FAILURE;
+                thorin.world().enable_history(track_history);
+        #endif
 
-        thorin.world().enable_history(track_history);
-#endif
+                // the Locs of the loaded interfaces refer to these names while the module is alive
+                std::deque<std::string> interface_files;
+                impala::Items items;
+                for (const auto& infile : infiles) {
+                    auto filename = infile.c_str();
+                    std::ifstream file(filename);
+                    impala::parse(items, file, filename);
+                }
 
-        impala::Items items;
-        for (const auto& infile : infiles) {
-            auto filename = infile.c_str();
-            std::ifstream file(filename);
-            impala::parse(items, file, filename);
-        }
+                // the interface covers this module only - not the interfaces it imports
+                std::ostringstream interface;
+                std::unordered_set<const impala::FnDecl*> interface_decls;
+                if (emit_interface)
+                    interface_decls = impala::generate_interface(items, interface);
+
+                {
+                    auto dir = infiles.front().find_last_of('/');
+                    Names paths = { dir == std::string::npos ? std::string() : infiles.front().substr(0, dir) };
+                    paths.insert(paths.end(), import_paths.begin(), import_paths.end());
+                    impala::load_interfaces(items, paths, interface_files);
+                }
 
-        auto module = std::make_unique<const impala::Module>(infiles.front().c_str(), std::move(items));
+                auto module = std::make_unique<const impala::Module>(infiles.front().c_str(), std::move(items));
 
-        if (emit_ast)
-            module->dump();
+                if (emit_ast)
+                    module->dump();
 
-        std::unique_ptr<impala::TypeTable> typetable;
-        impala::check(typetable, module.get());
-        bool result = impala::num_errors() == 0;
+                std::unique_ptr<impala::TypeTable> typetable;
+                impala::check(typetable, module.get());
+                bool result = impala::num_errors() == 0;
 
-        if (emit_annotated)
-            module->dump();
+                if (emit_annotated)
+                    module->dump();
 
-        if (result && emit_cint) {
-            impala::CGenOptions opts;
+                if (result && !multiversion.empty() && first) {
+                    auto name = module_name + ".dispatch.c";
+                    std::ofstream out_file(name);
+                    if (!out_file) {
+                        thorin::errf("cannot open file '{}' for writing", name);
+                        return EXIT_FAILURE;
+                    }
+                    if (!impala::generate_cpu_dispatcher(module.get(), targets, out_file, c_abi))
+                        return EXIT_FAILURE;
+                }
 
-            size_t pos = module_name.find_last_of("\\/");
-            pos = (pos == std::string::npos) ? 0 : pos + 1;
-            opts.file_name = module_name.substr(pos) + ".h";
+                if (result && emit_interface && first)
+                    write_if_changed(module_name + ".impi", interface.str());
+
+                if (result && emit_cint && first) {
+                    impala::CGenOptions opts;
+                    opts.c_abi = c_abi;
+
+                    size_t pos = module_name.find_last_of("\\/");
+                    pos = (pos == std::string::npos) ? 0 : pos + 1;
+                    opts.file_name = module_name.substr(pos) + ".h";
+
+                    // Generate a valid include guard macro name
+                    opts.guard = opts.file_name;
+                    if (!std::isalpha(opts.guard[0]) && opts.guard[0] != '_') opts.guard.insert(opts.guard.begin(), '_');
+                    transform(opts.guard.begin(), opts.guard.end(), opts.guard.begin(), [] (char c) -> char {
+                        if (!std::isalnum(c)) return '_';
+                        return ::toupper(c);
+                    });
+                    opts.guard[opts.guard.length() - 2] = '_';
+
+                    std::ofstream out_file(module_name + ".h");
+                    if (!out_file) {
+                        thorin::errf("cannot open file '{}' for writing", opts.file_name);
+                        return EXIT_FAILURE;
+                    }
+                    impala::generate_c_interface(module.get(), opts, out_file);
+                }
 
-            // Generate a valid include guard macro name
-            opts.guard = opts.file_name;
-            if (!std::isalpha(opts.guard[0]) && opts.guard[0] != '_') opts.guard.insert(opts.guard.begin(), '_');
-            transform(opts.guard.begin(), opts.guard.end(), opts.guard.begin(), [] (char c) -> char {
-                if (!std::isalnum(c)) return '_';
-                return ::toupper(c);
-            });
-            opts.guard[opts.guard.length() - 2] = '_';
+                if (result && (emit_c || emit_cpu || emit_thorin)) {
+                    impala::EmitOptions emit_opts;
+                    emit_opts.profile_generate = profile_generate;
+                    emit_opts.profile_use = profile_use;
+                    emit_opts.instrument_functions = instrument_functions;
+                    emit_opts.instrument_filter = instrument_filter;
+                    if (instrument_functions)
+                        emit_opts.trace_table = variant_name + ".tracemap";
+                    emit_opts.export_suffix = target.suffix;
+                    // main is not dispatched: only the fallback exports it under its own name
+                    emit_opts.export_main = &target == &targets.back();
+                    emit_opts.pe_disabled = pe_disabled;
+                    emit_opts.pe_filters = &pe_filters;
+                    emit_opts.export_items = interface_decls;
+                    emit_opts.c_abi = c_abi;
+    #ifdef LLVM_SUPPORT
+                    emit_opts.typed_pointers = LLVM_VERSION_MAJOR < 15;
+                    emit_opts.llvm_cpu = emit_cpu && !emit_c;
+    #endif
+    #ifdef NDEBUG
+                    emit_opts.names = names || debug || emit_thorin;
+    #endif
+                    impala::emit(thorin.world(), module.get(), emit_opts);
+                    result = impala::num_errors() == 0;
+                }
 
-            std::ofstream out_file(module_name + ".h");
-            if (!out_file) {
-                thorin::errf("cannot open file '{}' for writing", opts.file_name);
-                return EXIT_FAILURE;
-            }
-            impala::generate_c_interface(module.get(), opts, out_file);
-        }
+                if (print_rss)
+                    thorin::outf("peak RSS after front end: {} KiB", peak_rss());
 
-        if (result && (emit_c || emit_llvm || emit_thorin))
-            impala::emit(thorin.world(), module.get());
-
-        if (result) {
-            //thorin::verify_mem(world);
-            if (!nocleanup)
-                thorin.cleanup();
-            if (opt_thorin)
-                thorin.opt();
-            if (emit_thorin)
-                thorin.world().dump_scoped();
-            if (emit_c || emit_llvm) {
-                thorin::DeviceBackends backends(thorin.world(), opt, debug, hls_flags);
-                auto emit_to_file = [&] (thorin::CodeGen& cg) {
-                    auto name = module_name + cg.file_ext();
-                    std::ofstream file(name);
-                    if (!file)
-                        throw std::runtime_error("cannot write '" + name + "': " + strerror(errno));
-                    else
-                        cg.emit_stream(file);
-                };
-                if (emit_c) {
-                    thorin::Cont2Config kernel_configs;
-                    thorin::c::CodeGen cg(thorin, kernel_configs, thorin::c::Lang::C99, debug, hls_flags);
-                    emit_to_file(cg);
-                }
-#ifdef LLVM_SUPPORT
-                if (emit_llvm) {
-                    thorin::llvm::CPUCodeGen cg(thorin, opt, debug, host_triple, host_cpu, host_attr);
-                    emit_to_file(cg);
+                if (low_mem) {
+                    // Thorin does not refer to the AST or the Impala types anymore
+                    module.reset();
+                    typetable.reset();
                 }
-#endif
-                for (auto& cg : backends.cgs) {
-                    if (cg) emit_to_file(*cg);
+
+                if (result) {
+                    //thorin::verify_mem(world);
+                    if (!nocleanup)
+                        thorin.cleanup();
+                    if (opt_thorin)
+                        thorin.opt();
+                    if (opt_thorin && (pe_budgets || !pe_report.empty())) {
+                        impala::count_specializations(thorin.world(), pe_filters);
+                        if (pe_budgets) {
+                            auto disabled = over_budget(pe_filters, pe_budget, pe_budget_total, fn_budgets);
+                            if (!disabled.empty()) {
+                                for (auto filter : disabled) {
+                                    thorin::outf("{}: filter of '{}' disabled after {} specializations", filter->where, filter->name, filter->num_specializations);
+                                    pe_disabled.push_back(filter->where);
+                                }
+                                retry = true;
+                                continue;
+                            }
+                        }
+                        if (!pe_report.empty() && first)
+                            write_pe_report(pe_report, pe_filters, pe_disabled);
+                    }
+                    if (emit_thorin && first)
+                        thorin.world().dump_scoped();
+                    if (emit_c || emit_cpu) {
+                        thorin::DeviceBackends backends(thorin.world(), opt, debug, hls_flags);
+                        // the kernels carry the -fprofile-use hints meant for the LLVM CPU backend as well
+                        if (!profile_use.empty() && std::any_of(backends.cgs.begin(), backends.cgs.end(), [] (auto& cg) { return cg != nullptr; }))
+                            throw std::invalid_argument("-fprofile-use is not supported for programs with device kernels");
+                        auto emit_to_file = [&] (thorin::CodeGen& cg) {
+                            auto name = variant_name + cg.file_ext();
+                            std::ofstream file(name);
+                            if (!file)
+                                throw std::runtime_error("cannot write '" + name + "': " + strerror(errno));
+                            else
+                                cg.emit_stream(file);
+                        };
+                        if (emit_c && first) {
+                            thorin::Cont2Config kernel_configs;
+                            thorin::c::CodeGen cg(thorin, kernel_configs, thorin::c::Lang::C99, debug, hls_flags);
+                            emit_to_file(cg);
+                        }
+        #ifdef LLVM_SUPPORT
+                        if (emit_llvm) {
+                            thorin::llvm::CPUCodeGen cg(thorin, opt, debug, host_triple, target.cpu, target.attr);
+                            emit_to_file(cg);
+                        } else if (emit_bc || emit_obj) {
+                            thorin::llvm::CPUCodeGen cg(thorin, opt, debug, host_triple, target.cpu, target.attr);
+                            emit_llvm_binary(cg, variant_name, emit_obj ? ".o" : ".bc", emit_obj, opt, target.cpu, target.attr, codegen_units);
+                        }
+        #endif
+                        for (auto& cg : backends.cgs) {
+                            if (cg && first) emit_to_file(*cg);
+                        }
+                    }
+                } else {
+                    return EXIT_FAILURE;
                 }
-            }
-        } else {
-            return EXIT_FAILURE;
+            } while (retry);
         }
 
+        if (print_rss)
+            thorin::outf("peak RSS: {} KiB", peak_rss());
+
         return EXIT_SUCCESS;
     } catch (std::exception const& e) {
         thorin::errf("{}", e.what());
@@ -1,9 +1,7 @@
 #include <algorithm>
-#include <functional>
+#include <initializer_list>
 #include <sstream>
 
-#include "thorin/util/array.h"
-
 #include "impala/ast.h"
 #include "impala/impala.h"
 #include "impala/lexer.h"
@@ -107,22 +105,22 @@ class Parser;
 
 class Parser {
 public:
-    Parser(std::istream& stream, const char* filename)
-        : lexer_(stream, filename)
+    Parser(std::istream& stream, const char* filename, Pos begin)
+        : lexer_(stream, filename, begin)
     {
-        lookahead_[0] = lexer_.lex();
-        lookahead_[1] = lexer_.lex();
-        lookahead_[2] = lexer_.lex();
-        prev_loc_ = Loc(filename, {1, 1});
+        tokens_[0] = lexer_.lex();
+        tokens_[1] = lexer_.lex();
+        tokens_[2] = lexer_.lex();
+        tokens_[3] = Token(Loc(filename, begin), Token::Eof);
     }
 
-    const Token& lookahead(size_t i = 0) const { assert(i < 3); return lookahead_[i]; }
-    Loc prev_loc() const { return prev_loc_; }
+    const Token& lookahead(size_t i = 0) const { assert(i < 3); return tokens_[(head_ + i) % 4]; }
+    Loc prev_loc() const { return tokens_[(head_ + 3) % 4].loc(); }
 
 #ifdef NDEBUG
-    Token eat(TokenTag) { return lex(); }
+    const Token& eat(TokenTag) { return lex(); }
 #else
-    Token eat(TokenTag tag) { assert(tag == lookahead() && "internal parser error"); return lex(); }
+    const Token& eat(TokenTag tag) { assert(tag == lookahead() && "internal parser error"); return lex(); }
 #endif
 
     bool accept(TokenTag tok);
@@ -154,12 +152,10 @@ public:
      * The ending delimiter will @em not be eaten up by this method.
      * The list may also end with a comma.
      */
-    void nibble_comma_list(Array<TokenTag> delimiters, std::function<void()> f) {
+    template<class F>
+    void nibble_comma_list(std::initializer_list<TokenTag> delimiters, F f) {
         auto is_delimiter = [&] () {
-            for (auto delimiter : delimiters)
-                if (lookahead() == delimiter)
-                    return true;
-            return false;
+            return std::find(delimiters.begin(), delimiters.end(), lookahead().tag()) != delimiters.end();
         };
 
         if (!is_delimiter()) {
@@ -169,7 +165,8 @@ public:
     }
 
     /// Like @p nibble_comma_list but there is only one @p delimiter which @em will be eaten up by this method.
-    void parse_comma_list(const char* context, TokenTag delimiter, std::function<void()> f) {
+    template<class F>
+    void parse_comma_list(const char* context, TokenTag delimiter, F f) {
         nibble_comma_list({delimiter}, f);
         expect(delimiter, context);
     }
@@ -208,6 +205,7 @@ public:
     const TupleASTType* parse_tuple_type();
     const SimdASTType*  parse_simd_type();
     const ASTTypeApp*   parse_ast_type_app();
+    const ASTType*      parse_dim_type(const char* what);
 
     enum class BodyMode { None, Optional, Mandatory };
 
@@ -267,8 +265,8 @@ public:
     const AsmStmt::Elem* parse_asm_op();
 
 private:
-    /// Consume next Token in input stream, fill look-ahead buffer, return consumed Token.
-    Token lex();
+    /// Consume next Token in input stream, fill look-ahead buffer, return consumed Token - valid till the next call.
+    const Token& lex();
 
     const LocalDecl* create_continuation_decl(const char* name, bool set_type) {
         auto identifier = create<Identifier>(name);
@@ -276,15 +274,15 @@ private:
         return create<LocalDecl>(identifier, ast_type);
     }
 
-    Lexer lexer_;        ///< invoked in order to get next token
-    Token lookahead_[3]; ///< SLL(3) look ahead
-    Loc prev_loc_;
+    Lexer lexer_;     ///< invoked in order to get next token
+    Token tokens_[4]; ///< ring buffer: SLL(3) look ahead starting at @p head_ followed by the previous token
+    size_t head_ = 0;
 };
 
 //------------------------------------------------------------------------------
 
-void parse(Items& items, std::istream& is, const char* filename) {
-    Parser parser(is, filename);
+void parse(Items& items, std::istream& is, const char* filename, Pos begin) {
+    Parser parser(is, filename, begin);
     parser.parse_items(items);
     if (parser.lookahead() != Token::Eof)
         parser.error("module item", "module contents");
@@ -296,12 +294,10 @@ void parse(Items& items, std::istream& is, const char* filename) {
  * helpers
  */
 
-Token Parser::lex() {
-    Token result = lookahead_[0];  // remember result
-    lookahead_[0] = lookahead_[1]; // copy over LA2 to LA1
-    lookahead_[1] = lookahead_[2]; // copy over LA3 to LA2
-    lookahead_[2] = lexer_.lex();  // fill new LA3
-    prev_loc_ = result.loc(); // remember previous loc
+const Token& Parser::lex() {
+    auto& result = tokens_[head_];               // becomes the previous token
+    head_ = (head_ + 1) % 4;
+    tokens_[(head_ + 2) % 4] = lexer_.lex();     // fill new LA3 in place of the old previous token
     return result;
 }
 
@@ -405,15 +401,16 @@ ASTTypeParams Parser::parse_ast_type_params() {
 
 const ASTTypeParam* Parser::parse_ast_type_param() {
     auto tracker = track();
+    bool is_const = accept(Token::CONST);
     auto identifier = try_identifier("type parameter");
     ASTTypes bounds;
-    if (accept(Token::COLON)) {
+    if (!is_const && accept(Token::COLON)) {
         do {
             bounds.emplace_back(parse_type());
         } while (accept(Token::ADD));
     }
 
-    return new ASTTypeParam(tracker, identifier, std::move(bounds));
+    return new ASTTypeParam(tracker, identifier, std::move(bounds), is_const);
 }
 
 Params Parser::parse_param_list(TokenTag delimiter, bool lambda) {
@@ -645,6 +642,7 @@ const StaticItem* Parser::parse_static_item(Tracker tracker, Visibility vis) {
 
 const StructDecl* Parser::parse_struct_decl(Tracker tracker, Visibility vis) {
     eat(Token::STRUCT);
+    auto layout = lookahead() == Token::LIT_str ? lex().symbol() : Symbol();
     auto identifier = try_identifier("struct declaration");
     auto ast_type_params = parse_ast_type_params();
     expect(Token::L_BRACE, "struct declaration");
@@ -653,7 +651,7 @@ const StructDecl* Parser::parse_struct_decl(Tracker tracker, Visibility vis) {
     parse_comma_list("closing brace of struct declaration", Token::R_BRACE, [&] {
         field_decls.emplace_back(parse_field_decl(i++));
     });
-    return new StructDecl(tracker, vis, identifier, std::move(ast_type_params), std::move(field_decls));
+    return new StructDecl(tracker, vis, layout, identifier, std::move(ast_type_params), std::move(field_decls));
 }
 
 const FieldDecl* Parser::parse_field_decl(const size_t i) {
@@ -715,6 +713,14 @@ const ASTType* Parser::parse_type() {
         case Token::AND:
         case Token::ANDAND:     return parse_ptr_type();
         case Token::SIMD:       return parse_simd_type();
+        case Token::LIT_i8:
+        case Token::LIT_i16:
+        case Token::LIT_i32:
+        case Token::LIT_i64:
+        case Token::LIT_u8:
+        case Token::LIT_u16:
+        case Token::LIT_u32:
+        case Token::LIT_u64:    return parse_dim_type("argument of const type parameter");
         default:  {
             error("type", "");
             return create<ErrorASTType>();
@@ -727,9 +733,9 @@ const ArrayASTType* Parser::parse_array_type() {
     eat(Token::L_BRACKET);
     auto elem_ast_type = parse_type();
     if (accept(Token::MUL)) {
-        auto dim = parse_integer("definite array type");
+        auto dim_ast_type = parse_dim_type("definite array type");
         expect(Token::R_BRACKET, "definite array type");
-        return new DefiniteArrayASTType(tracker, elem_ast_type, dim);
+        return new DefiniteArrayASTType(tracker, elem_ast_type, dim_ast_type);
     }
 
     expect(Token::R_BRACKET, "indefinite array type");
@@ -846,9 +852,19 @@ const SimdASTType* Parser::parse_simd_type() {
     expect(Token::L_BRACKET, "simd type");
     auto elem_ast_type = parse_type();
     expect(Token::MUL, "simd type");
-    auto size = parse_integer("simd vector size");
+    auto dim_ast_type = parse_dim_type("simd vector size");
     expect(Token::R_BRACKET, "simd type");
-    return new SimdASTType(tracker, elem_ast_type, size);
+    return new SimdASTType(tracker, elem_ast_type, dim_ast_type);
+}
+
+const ASTType* Parser::parse_dim_type(const char* what) {
+    // name of a const type parameter
+    if (lookahead() == Token::ID)
+        return parse_ast_type_app();
+
+    auto tracker = track();
+    auto value = parse_integer(what);
+    return new DimASTType(tracker, value);
 }
 
 /*
@@ -1382,8 +1398,6 @@ const AsmStmt::Elem* Parser::parse_asm_op() {
 }
 
 const AsmStmt* Parser::parse_asm_stmt() {
-    static const Array<TokenTag> delimiters = {Token::COLON, Token::DOUBLE_COLON, Token::R_PAREN};
-
     auto tracker = track();
     eat(Token::ASM);
     expect(Token::L_PAREN, "asm statement");
@@ -1396,13 +1410,13 @@ const AsmStmt* Parser::parse_asm_stmt() {
     if (accept(Token::R_PAREN))      goto out;
 
 parse_outputs:
-    nibble_comma_list(delimiters, [&]{ outputs.emplace_back(parse_asm_op()); });
+    nibble_comma_list({Token::COLON, Token::DOUBLE_COLON, Token::R_PAREN}, [&]{ outputs.emplace_back(parse_asm_op()); });
     if (accept(Token::COLON))        goto parse_inputs;
     if (accept(Token::DOUBLE_COLON)) goto parse_clobbers;
     if (accept(Token::R_PAREN))      goto out;
 
 parse_inputs:
-    nibble_comma_list(delimiters, [&]{ inputs.emplace_back(parse_asm_op()); });
+    nibble_comma_list({Token::COLON, Token::DOUBLE_COLON, Token::R_PAREN}, [&]{ inputs.emplace_back(parse_asm_op()); });
     if (accept(Token::COLON))        goto parse_clobbers;
     if (accept(Token::DOUBLE_COLON)) goto parse_options;
     if (accept(Token::R_PAREN))      goto out;
@@ -76,12 +76,13 @@ public:
         return constrain(ast_type, ast_type->infer(*this));
     }
 
-    const Type* infer_call(const Expr* lhs, ArrayRef<const Expr*> args, const Type* call_type);
-    const Type* infer_call(const Expr* lhs, const Exprs& args, const Type* call_type) {
+    /// @p ret_type, if given, is the known return type of builtins whose generic signature cannot express it.
+    const Type* infer_call(const Expr* lhs, ArrayRef<const Expr*> args, const Type* call_type, const Type* ret_type = nullptr);
+    const Type* infer_call(const Expr* lhs, const Exprs& args, const Type* call_type, const Type* ret_type = nullptr) {
         Array<const Expr*> array(args.size());
         for (size_t i = 0, e = args.size(); i != e; ++i)
             array[i] = args[i].get();
-        return infer_call(lhs, array, call_type);
+        return infer_call(lhs, array, call_type, ret_type);
     }
 
     const Type* rvalue(const Expr* expr) {
@@ -248,6 +249,9 @@ const Type* InferSema::unify(const Type* dst, const Type* src) {
     if (dst->isa<TypeError>() || dst->isa<InferError>()) return dst; // propagate errors
     if (src->isa<TypeError>() || src->isa<InferError>()) return src; // dito
 
+    if (dst->isa<IndefiniteArrayType>() && src->isa<DefiniteArrayType>())
+        return indefinite_array_type(unify(dst->op(0), src->op(0)));
+
     if (dst->num_ops() == src->num_ops()) {
         // do not unify the operands if the types do not match
         if (auto dst_borrowed_ptr_type = dst->isa<BorrowedPtrType>()) {
@@ -259,9 +263,6 @@ const Type* InferSema::unify(const Type* dst, const Type* src) {
             }
         }
 
-        if (dst->isa<IndefiniteArrayType>() && src->isa<DefiniteArrayType>())
-            return indefinite_array_type(unify(dst->op(0), src->op(0)));
-
         if (dst->tag() == src->tag()) {
             // Handle nominal types
             if (src->is_nominal() && src != dst)
@@ -342,6 +343,9 @@ void type_inference(std::unique_ptr<TypeTable>& typetable, const Module* module)
         sema->infer(module);
     }
 
+    // the union-find forest is only needed during inference - replace it to free the table as well
+    sema->representatives_ = decltype(sema->representatives_)();
+
     //DLOG("iterations needed for type inference: {}", i);
 }
 
@@ -423,8 +427,9 @@ const Type* PtrASTType::infer(InferSema& sema) const {
 }
 
 const Type* IndefiniteArrayASTType::infer(InferSema& sema) const { return sema.indefinite_array_type(sema.infer(elem_ast_type())); }
-const Type* DefiniteArrayASTType::infer(InferSema& sema) const { return sema.definite_array_type(sema.infer(elem_ast_type()), dim()); }
-const Type* SimdASTType::infer(InferSema& sema) const { return sema.simd_type(sema.infer(elem_ast_type()), size()); }
+const Type* DefiniteArrayASTType::infer(InferSema& sema) const { return sema.definite_array_type(sema.infer(elem_ast_type()), sema.infer(dim_ast_type())); }
+const Type* DimASTType::infer(InferSema& sema) const { return sema.dim_type(value()); }
+const Type* SimdASTType::infer(InferSema& sema) const { return sema.simd_type(sema.infer(elem_ast_type()), sema.infer(dim_ast_type())); }
 
 const Type* TupleASTType::infer(InferSema& sema) const {
     Array<const Type*> types(num_ast_type_args());
@@ -650,6 +655,8 @@ const Type* PathExpr::infer(InferSema& sema) const {
         auto type = sema.find_type(value_decl());
         return value_decl()->is_mut() ? sema.ref_type(type, true, 0) : type;
     }
+    if (const_param())
+        return sema.type_i32();
 
     return sema.type_error();
 }
@@ -708,7 +715,7 @@ const Type* InfixExpr::infer(InferSema& sema) const {
             sema.constrain(lhs(), rtype);
             sema.constrain(rhs(), ltype);
             if (auto simd = rhs()->type()->isa<SimdType>())
-                return sema.simd_type(sema.type_bool(), simd->dim());
+                return sema.simd_type(sema.type_bool(), simd->dim_type());
             return sema.type_bool();
         }
         case OROR:
@@ -843,7 +850,7 @@ const Type* StructExpr::infer(InferSema& sema) const {
     return type;
 }
 
-const Type* InferSema::infer_call(const Expr* lhs, ArrayRef<const Expr*> args, const Type* call_type) {
+const Type* InferSema::infer_call(const Expr* lhs, ArrayRef<const Expr*> args, const Type* call_type, const Type* ret_type) {
     auto fn_type = lhs->type()->as<FnType>();
 
     if (args.size() == fn_type->num_params()) {
@@ -858,7 +865,7 @@ const Type* InferSema::infer_call(const Expr* lhs, ArrayRef<const Expr*> args, c
         Array<const Type*> types(args.size()+1);
         for (size_t i = 0, e = args.size(); i != e; ++i)
             types[i] = coerce(fn_type->param(i), args[i]);
-        types.back() = fn_type->last_param();
+        types.back() = ret_type ? this->fn_type({ret_type}) : fn_type->last_param();
 
         auto result = constrain(lhs, this->fn_type(types));
         if (auto fn_type = result->isa<FnType>())
@@ -914,6 +921,32 @@ const Type* TypeAppExpr::infer(InferSema& sema) const {
     return sema.find_type(this);
 }
 
+/// Result type of the SIMD builtins @c reduce_* and @c gather which only depends on the types of their arguments.
+static const Type* simd_builtin_type(InferSema& sema, const MapExpr* map_expr) {
+    switch (map_expr->intrinsic()) {
+        case Intrinsic::ReduceAdd: case Intrinsic::ReduceMul: case Intrinsic::ReduceMin: case Intrinsic::ReduceMax:
+        case Intrinsic::ReduceAnd: case Intrinsic::ReduceOr:  case Intrinsic::ReduceXor:
+            if (map_expr->num_args() == 1) {
+                if (auto simd_type = map_expr->arg(0)->type()->isa<SimdType>())
+                    return simd_type->elem_type();
+            }
+            break;
+        case Intrinsic::Gather:
+            if (map_expr->num_args() == 3) {
+                auto ptr_type = map_expr->arg(0)->type()->isa<PtrType>();
+                auto array_type = ptr_type ? ptr_type->pointee()->isa<ArrayType>() : nullptr;
+                auto index_type = map_expr->arg(1)->type()->isa<SimdType>();
+                if (array_type && index_type)
+                    return sema.simd_type(array_type->elem_type(), index_type->dim_type());
+            }
+            break;
+        default:
+            break;
+    }
+
+    return nullptr;
+}
+
 const Type* MapExpr::infer(InferSema& sema) const {
     auto ltype = sema.infer(lhs());
     if (is_ptr(ltype)) {
@@ -952,7 +985,7 @@ const Type* MapExpr::infer(InferSema& sema) const {
     }
 
     if (ltype->isa<FnType>())
-        return sema.infer_call(lhs(), args(), sema.find_type(this));
+        return sema.infer_call(lhs(), args(), sema.find_type(this), simd_builtin_type(sema, this));
 
     return sema.type_error();
 }
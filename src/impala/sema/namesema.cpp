@@ -59,6 +59,8 @@ const Decl* NameSema::lookup(const ASTNode* n, Symbol symbol) {
         auto decl = symbol2decl_.lookup(symbol);
         if (!decl)
             error(n, "'{}' not found in current scope", symbol);
+        else if (auto index = impala::index())
+            index->uses.emplace_back(n->loc(), *decl);
         return *decl;
     } else {
         error(n, "identifier '_' is reserved for anonymous declarations");
@@ -146,8 +148,9 @@ void ErrorASTType::bind(NameSema&) const {}
 void PrimASTType::bind(NameSema&) const {}
 void PtrASTType::bind(NameSema& sema) const { referenced_ast_type()->bind(sema); }
 void IndefiniteArrayASTType::bind(NameSema& sema) const { elem_ast_type()->bind(sema); }
-void DefiniteArrayASTType::bind(NameSema& sema) const { elem_ast_type()->bind(sema); }
-void SimdASTType::bind(NameSema& sema) const { elem_ast_type()->bind(sema); }
+void DefiniteArrayASTType::bind(NameSema& sema) const { elem_ast_type()->bind(sema); dim_ast_type()->bind(sema); }
+void DimASTType::bind(NameSema&) const {}
+void SimdASTType::bind(NameSema& sema) const { elem_ast_type()->bind(sema); dim_ast_type()->bind(sema); }
 void Typeof::bind(NameSema& sema) const { expr()->bind(sema); }
 
 void TupleASTType::bind(NameSema& sema) const {
@@ -248,6 +251,8 @@ void Fn::fn_bind(NameSema& sema) const {
 }
 
 void FnDecl::bind(NameSema& sema) const {
+    if (is_extern() && abi() == "\"thorin\"")
+        intrinsic_ = find_intrinsic(fn_symbol().remove_quotation());
     fn_bind(sema);
 }
 
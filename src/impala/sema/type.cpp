@@ -65,6 +65,10 @@ bool is_subtype(const Type* dst, const Type* src) {
         // structs and enums are the only nominal types
         return false;
 
+    if (dst->isa<DimType>())
+        // dimensions only match if they are equal
+        return false;
+
     if (auto dst_borrowed_ptr_type = dst->isa<BorrowedPtrType>()) {
         if (auto src_owned_ptr_type = src->isa<OwnedPtrType>()) {
             return src_owned_ptr_type->addr_space() == dst_borrowed_ptr_type->addr_space()
@@ -82,12 +86,8 @@ bool is_subtype(const Type* dst, const Type* src) {
     if (dst->tag() == src->tag() && dst->num_ops() == src->num_ops()) {
         bool result = true;
 
-        // special cases for DefiniteArrays, SimdTypes and PtrTypes
-        if (auto dst_def_array = dst->isa<DefiniteArrayType>())
-            result &= src->as<DefiniteArrayType>()->dim() == dst_def_array->dim();
-        else if (auto dst_simd_type = dst->isa<SimdType>())
-            result &= src->as<SimdType>()->dim() == dst_simd_type->dim();
-        else if (auto dst_ref_type = dst->isa<RefTypeBase>())
+        // special case for PtrTypes - dimensions of DefiniteArrays and SimdTypes are compared as operands
+        if (auto dst_ref_type = dst->isa<RefTypeBase>())
             result &=  src->as<RefTypeBase>()->is_mut() == dst_ref_type->is_mut()
                     && src->as<RefTypeBase>()->addr_space() == dst_ref_type->addr_space();
 
@@ -115,6 +115,16 @@ bool is_strict_subtype(const Type* dst, const Type* src) {
     return dst != src && is_subtype(dst, src);
 }
 
+const StructType* soa_struct_type(const Type* type) {
+    if (type->isa<DefiniteArrayType>() || type->isa<IndefiniteArrayType>()) {
+        if (auto struct_type = type->as<ArrayType>()->elem_type()->isa<StructType>()) {
+            if (struct_type->struct_decl()->is_soa())
+                return struct_type;
+        }
+    }
+    return nullptr;
+}
+
 //------------------------------------------------------------------------------
 
 /*
@@ -129,6 +139,8 @@ hash_t Var::vhash() const {
     return thorin::murmur3(hash_t(tag()) << hash_t(32-8) | uint8_t(depth()));
 }
 
+hash_t DimType::vhash() const { return thorin::hash_combine(Type::vhash(), value()); }
+
 //------------------------------------------------------------------------------
 
 /*
@@ -145,6 +157,10 @@ bool Var::equal(const Type* other) const {
     return other->isa<Var>() ? this->as<Var>()->depth() == other->as<Var>()->depth() : false;
 }
 
+bool DimType::equal(const Type* other) const {
+    return other->isa<DimType>() ? this->value() == other->as<DimType>()->value() : false;
+}
+
 bool UnknownType::equal(const Type* other) const { return this == other; }
 
 //------------------------------------------------------------------------------
@@ -158,11 +174,12 @@ const Type* FnType             ::vrebuild(TypeTable& to, Types ops) const { retu
 const Type* App                ::vrebuild(TypeTable& to, Types ops) const { return to.app(ops[0], ops[1]); }
 const Type* Lambda             ::vrebuild(TypeTable& to, Types ops) const { return to.lambda(ops[0], name()); }
 const Type* Var                ::vrebuild(TypeTable& to, Types    ) const { return to.var(depth()); }
+const Type* DimType            ::vrebuild(TypeTable& to, Types    ) const { return to.dim_type(value()); }
 const Type* TupleType          ::vrebuild(TypeTable& to, Types ops) const { return to.tuple_type(ops); }
 const Type* StructType         ::vrebuild(TypeTable&   , Types    ) const { return this; }
 const Type* EnumType           ::vrebuild(TypeTable&   , Types    ) const { return this; }
-const Type* DefiniteArrayType  ::vrebuild(TypeTable& to, Types ops) const { return to.  definite_array_type(ops[0], dim()); }
-const Type* SimdType           ::vrebuild(TypeTable& to, Types ops) const { return to.            simd_type(ops[0], dim()); }
+const Type* DefiniteArrayType  ::vrebuild(TypeTable& to, Types ops) const { return to.  definite_array_type(ops[0], ops[1]); }
+const Type* SimdType           ::vrebuild(TypeTable& to, Types ops) const { return to.            simd_type(ops[0], ops[1]); }
 const Type* IndefiniteArrayType::vrebuild(TypeTable& to, Types ops) const { return to.indefinite_array_type(ops[0]); }
 const Type* BorrowedPtrType    ::vrebuild(TypeTable& to, Types ops) const { return to.borrowed_ptr_type(ops[0], is_mut(), addr_space()); }
 const Type* OwnedPtrType       ::vrebuild(TypeTable& to, Types ops) const { return to.   owned_ptr_type(ops[0], addr_space()); }
@@ -240,9 +257,10 @@ Stream& TypeBase<TypeTable>::stream(Stream& s) const {
     } else if (auto t = isa<InferError>())          { return s.fmt("<infer error: {}, {}>", t->dst(), t->src());
     } else if (auto t = isa<Var>())                 { return s.fmt("<{}>", t->depth());
     } else if (auto t = isa<App>())                 { return s.fmt("{}[{}]", t->callee(), t->arg());
-    } else if (auto t = isa<DefiniteArrayType>())   { return s.fmt("[{} * {}]", t->elem_type(), t->dim());
+    } else if (auto t = isa<DimType>())             { return s.fmt("{}", t->value());
+    } else if (auto t = isa<DefiniteArrayType>())   { return s.fmt("[{} * {}]", t->elem_type(), t->dim_type());
     } else if (auto t = isa<IndefiniteArrayType>()) { return s.fmt("[{}]", t->elem_type());
-    } else if (auto t = isa<SimdType>())            { return s.fmt("simd[{} * {}]", t->elem_type(), t->dim());
+    } else if (auto t = isa<SimdType>())            { return s.fmt("simd[{} * {}]", t->elem_type(), t->dim_type());
     } else if (auto t = isa<StructType>())          { return s.fmt("{}", t->struct_decl()->symbol().str());
     } else if (auto t = isa<EnumType>())            { return s.fmt("{}", t->enum_decl()->symbol().str());
     } else if (auto t = isa<TupleType>())           { return s.fmt("({, })", t->ops());
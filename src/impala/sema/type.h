@@ -21,6 +21,7 @@ enum Tag {
     Tag_app,
     Tag_borrowed_ptr,
     Tag_definite_array,
+    Tag_dim,
     Tag_error,
     Tag_fn,
     Tag_impl,
@@ -114,7 +115,12 @@ private:
     friend class TypeTable;
 };
 
-/// Pointer @p Type.
+/**
+ * Pointer @p Type.
+ * Pointers into the generic address space 0 are assumed to be non-null and to never point into the first page:
+ * enums with a single pointer payload encode their other options as such addresses.
+ * Casting an integer like @c 0 to a pointer type and wrapping it into such an enum yields one of the other options.
+ */
 class PtrType : public RefTypeBase {
 protected:
     PtrType(TypeTable& typetable, int tag, const Type* pointee, bool mut, uint64_t addr_space)
@@ -255,6 +261,30 @@ private:
     friend class TypeTable;
 };
 
+/**
+ * Compile-time integer standing for the dimension of a @p DefiniteArrayType or the width of a @p SimdType.
+ * A @c const type parameter is a @p Var in the same position which is replaced by a @p DimType when the function is specialized.
+ */
+class DimType : public Type {
+private:
+    DimType(TypeTable& table, uint64_t value)
+        : Type(table, Tag_dim, {})
+        , value_(value)
+    {}
+
+public:
+    uint64_t value() const { return value_; }
+
+private:
+    hash_t vhash() const override;
+    bool equal(const Type*) const override;
+    const Type* vrebuild(TypeTable& to, Types ops) const override;
+
+    uint64_t value_;
+
+    friend class TypeTable;
+};
+
 class App : public Type {
 private:
     App(TypeTable& table, const Type* callee, const Type* arg)
@@ -338,6 +368,9 @@ protected:
     ArrayType(TypeTable& typetable, int tag, const Type* elem_type)
         : Type(typetable, tag, {elem_type})
     {}
+    ArrayType(TypeTable& typetable, int tag, const Type* elem_type, const Type* dim_type)
+        : Type(typetable, tag, {elem_type, dim_type})
+    {}
 
 public:
     const Type* elem_type() const { return op(0); }
@@ -357,46 +390,39 @@ private:
 
 class DefiniteArrayType : public ArrayType {
 public:
-    DefiniteArrayType(TypeTable& typetable, const Type* elem_type, uint64_t dim)
-        : ArrayType(typetable, Tag_definite_array, elem_type)
-        , dim_(dim)
+    DefiniteArrayType(TypeTable& typetable, const Type* elem_type, const Type* dim_type)
+        : ArrayType(typetable, Tag_definite_array, elem_type, dim_type)
     {}
 
-    uint64_t dim() const { return dim_; }
-    hash_t vhash() const override { return thorin::hash_combine(Type::vhash(), dim()); }
-    bool equal(const Type* other) const override {
-        return Type::equal(other) && this->dim() == other->as<DefiniteArrayType>()->dim();
-    }
+    /// A @p DimType or - within generic functions - a @p Var.
+    const Type* dim_type() const { return op(1); }
+    uint64_t dim() const { return dim_type()->as<DimType>()->value(); }
 
 private:
     const Type* vrebuild(TypeTable&, Types) const override;
 
-    uint64_t dim_;
-
     friend class TypeTable;
 };
 
 class SimdType : public ArrayType {
 public:
-    SimdType(TypeTable& typetable, const Type* elem_type, uint64_t dim)
-        : ArrayType(typetable, Tag_simd, elem_type)
-        , dim_(dim)
+    SimdType(TypeTable& typetable, const Type* elem_type, const Type* dim_type)
+        : ArrayType(typetable, Tag_simd, elem_type, dim_type)
     {}
 
-    uint64_t dim() const { return dim_; }
-    hash_t vhash() const override { return thorin::hash_combine(Type::vhash(), dim()); }
-    bool equal(const Type* other) const override {
-        return Type::equal(other) && this->dim() == other->as<SimdType>()->dim();
-    }
+    /// A @p DimType or - within generic functions - a @p Var.
+    const Type* dim_type() const { return op(1); }
+    uint64_t dim() const { return dim_type()->as<DimType>()->value(); }
 
 private:
     const Type* vrebuild(TypeTable&, Types) const override;
 
-    uint64_t dim_;
-
     friend class TypeTable;
 };
 
+/// Returns the element type if @p type is a (in)definite array of a struct with @c "soa" layout, @c nullptr otherwise.
+const StructType* soa_struct_type(const Type* type);
+
 class NoRetType : public Type {
 private:
     NoRetType(TypeTable& typetable)
@@ -475,15 +501,20 @@ public:
 
 #define IMPALA_TYPE(itype, atype) const PrimType* type_##itype() { return itype##_; }
 #include "impala/tokenlist.h"
+    const DimType* dim_type(uint64_t value) { return unify(new DimType(*this, value)); }
+    const DefiniteArrayType* definite_array_type(const Type* elem_type, const Type* dim_type) {
+        return unify(new DefiniteArrayType(*this, elem_type, dim_type));
+    }
     const DefiniteArrayType* definite_array_type(const Type* elem_type, uint64_t dim) {
-        return unify(new DefiniteArrayType(*this, elem_type, dim));
+        return definite_array_type(elem_type, dim_type(dim));
     }
     const FnType* fn_type(const Type* op) { return unify(new FnType(*this, op)); }
     const FnType* fn_type(Types params) { return unify(new FnType(*this, params.size() == 1 ? params.front() : tuple_type(params))); }
     const IndefiniteArrayType* indefinite_array_type(const Type* elem_type) {
         return unify(new IndefiniteArrayType(*this, elem_type));
     }
-    const SimdType* simd_type(const Type* elem_type, uint64_t size) { return unify(new SimdType(*this, elem_type, size)); }
+    const SimdType* simd_type(const Type* elem_type, const Type* dim_type) { return unify(new SimdType(*this, elem_type, dim_type)); }
+    const SimdType* simd_type(const Type* elem_type, uint64_t size) { return simd_type(elem_type, dim_type(size)); }
     const BorrowedPtrType* borrowed_ptr_type(const Type* pointee, bool mut, uint64_t addr_space) {
         return unify(new BorrowedPtrType(*this, pointee, mut, addr_space));
     }
@@ -85,6 +85,65 @@ public:
             error(n, "indefinite array '{}' not allowed as {} because its size is statically unknown; use a definite array or a pointer to an indefinite array instead", type, context);
     }
 
+    void no_soa_address(const Expr* expr, const char* context) {
+        auto map_expr = expr->isa<MapExpr>();
+        if (map_expr && map_expr->is_soa_access() && expr->type()->isa<RefType>())
+            error(expr, "cannot take the address of an element of '{}' as {} because its fields are stored in separate arrays", unpack_ref_type(map_expr->lhs()->type()), context);
+    }
+
+    // escape analysis - see LocalDecl::is_escaping
+
+    static const LocalDecl* local_of(const Expr* expr) {
+        if (auto path_expr = expr->skip_rvalue()->isa<PathExpr>()) {
+            if (auto value_decl = path_expr->value_decl())
+                return value_decl->isa<LocalDecl>();
+        }
+        return nullptr;
+    }
+
+    void use(const LocalDecl* local) { ++local->num_uses_; }
+
+    /// @p expr is only used to access memory through it like in @c *x, @c x(i) or @c x.f.
+    void access_in_place(const Expr* expr) {
+        if (auto local = local_of(expr)) {
+            // closures may outlive the function
+            if (local->fn() == cur_fn_)
+                ++local->num_in_place_uses_;
+        }
+    }
+
+    /// The address of @p lvalue is taken - the local it is part of or points into escapes.
+    void escape(const Expr* lvalue) {
+        while (true) {
+            lvalue = lvalue->skip_rvalue();
+            if (auto map_expr = lvalue->isa<MapExpr>())
+                lvalue = map_expr->lhs();
+            else if (auto field_expr = lvalue->isa<FieldExpr>())
+                lvalue = field_expr->lhs();
+            else if (auto prefix_expr = lvalue->isa<PrefixExpr>()) {
+                if (prefix_expr->tag() != PrefixExpr::MUL)
+                    break;
+                lvalue = prefix_expr->rhs();
+            } else
+                break;
+        }
+
+        if (auto local = local_of(lvalue))
+            local->is_escaping_ = true;
+    }
+
+    /// @p ast_type must be an integer literal or name a @c const type parameter.
+    void check_dim(const ASTType* ast_type, const char* what) {
+        if (ast_type->isa<DimASTType>())
+            return;
+        if (auto ast_type_app = ast_type->isa<ASTTypeApp>()) {
+            auto ast_type_param = ast_type_app->decl() ? ast_type_app->decl()->isa<ASTTypeParam>() : nullptr;
+            if (ast_type_param && ast_type_param->is_const())
+                return;
+        }
+        error(ast_type, "expected integer literal or const type parameter as {} but found '{}'", what, ast_type);
+    }
+
     // check wrappers
 
     const Var* check(const ASTTypeParam* ast_type_param) { ast_type_param->check(*this); return ast_type_param->var(); }
@@ -94,10 +153,16 @@ public:
     const Type* check(const LocalDecl* local) { local->check(*this); return local->type(); }
     const Type* check(const ASTType* ast_type) { ast_type->check(*this); return ast_type->type(); }
     void check(const Item* n) { n->check(*this); }
-    const Type* check(const Expr* expr) { expr->check(*this); return expr->type(); }
+    const Type* check(const Expr* expr) {
+        expr->check(*this);
+        if (auto index = impala::index())
+            index->exprs.push_back(expr);
+        return expr->type();
+    }
     const Type* check(const Ptrn* p) { p->check(*this); return p->type(); }
     void check(const Stmt* n) { n->check(*this); }
     void check_call(const Expr* expr, ArrayRef<const Expr*> args);
+    void check_simd_builtin(const MapExpr* map_expr);
     void check_call(const Expr* expr, const Exprs& args) {
         Array<const Expr*> array(args.size());
         for (size_t i = 0, e = args.size(); i != e; ++i)
@@ -146,11 +211,18 @@ void ErrorASTType::check(TypeSema& ) const {}
 void PrimASTType::check(TypeSema&) const {}
 void PtrASTType::check(TypeSema& sema) const { sema.check(referenced_ast_type()); }
 void IndefiniteArrayASTType::check(TypeSema& sema) const { sema.check(elem_ast_type()); }
-void   DefiniteArrayASTType::check(TypeSema& sema) const { sema.check(elem_ast_type()); }
+
+void DefiniteArrayASTType::check(TypeSema& sema) const {
+    sema.check(elem_ast_type());
+    sema.check_dim(dim_ast_type(), "dimension of definite array type");
+}
+
+void DimASTType::check(TypeSema&) const { error(this, "integer literal '{}' used as a type", value()); }
 
 void SimdASTType::check(TypeSema& sema) const {
     if (!sema.check(elem_ast_type())->isa<PrimType>())
         error(this, "non primitive types forbidden in simd type");
+    sema.check_dim(dim_ast_type(), "simd vector size");
 }
 
 void TupleASTType::check(TypeSema& sema) const {
@@ -172,6 +244,10 @@ void ASTTypeApp::check(TypeSema& sema) const {
     path()->check(sema);
     if (!decl() || !decl()->is_type_decl())
         error(identifier(), "'{}' does not name a type", symbol());
+    else if (auto ast_type_param = decl()->isa<ASTTypeParam>()) {
+        if (ast_type_param->is_const())
+            error(identifier(), "const type parameter '{}' used as a type", symbol());
+    }
 }
 
 void Typeof::check(TypeSema& sema) const { sema.check(expr()); }
@@ -219,6 +295,23 @@ void Path::check(TypeSema&) const {
  * items
  */
 
+/// Whether @p fn_type is <tt>fn(T, T, fn(T) -> ()) -> ()</tt> or <tt>fn(T, T, T, fn(T) -> ()) -> ()</tt> with an integer type @c T.
+static bool is_range_type(const FnType* fn_type) {
+    auto n = fn_type->num_params(); // including the return continuation
+    if ((n != 4 && n != 5) || !fn_type->is_returning() || !is_unit(fn_type->return_type()))
+        return false;
+
+    auto t = fn_type->param(0);
+    for (size_t i = 1; i != n - 2; ++i) {
+        if (fn_type->param(i) != t)
+            return false;
+    }
+
+    auto body = fn_type->param(n - 2)->isa<FnType>();
+    return is_int(t) && body && body->num_params() == 2 && body->param(0) == t
+        && body->is_returning() && is_unit(body->return_type());
+}
+
 void ModuleDecl::check(TypeSema&) const {
 }
 
@@ -229,12 +322,15 @@ void Module::check(TypeSema& sema) const {
 
 void ExternBlock::check(TypeSema& sema) const {
     if (!abi().empty()) {
-        if (abi() != "\"C\"" && abi() != "\"device\"" && abi() != "\"thorin\"")
+        if (abi() != "\"C\"" && abi() != "\"device\"" && abi() != "\"thorin\"" && abi() != "\"range\"")
             error(this, "unknown extern specification");  // TODO: better location
     }
 
-    for (auto&& fn_decl : fn_decls())
+    for (auto&& fn_decl : fn_decls()) {
         sema.check(fn_decl.get());
+        if (fn_decl->is_builtin_range() && !is_range_type(fn_decl->fn_type()))
+            error(fn_decl.get(), "'{}' must have type 'fn(T, T, fn(T) -> ()) -> ()' or 'fn(T, T, T, fn(T) -> ()) -> ()' with an integer type 'T'", fn_decl->symbol());
+    }
 }
 
 void Typedef::check(TypeSema& sema) const {
@@ -254,6 +350,9 @@ void OptionDecl::check(TypeSema& sema) const {
 
 void StructDecl::check(TypeSema& sema) const {
     check_ast_type_params(sema);
+    if (!layout().empty() && !is_soa())
+        error(this, "unknown struct layout {}", layout());
+
     for (auto&& field_decl : field_decls()) {
         sema.check(field_decl.get());
         sema.no_indefinite_array(field_decl.get(), field_decl->type(), "type for a struct field");
@@ -327,11 +426,12 @@ void PathExpr::check(TypeSema& sema) const {
     path()->check(sema);
     if (value_decl()) {
         if (auto local = value_decl()->isa<LocalDecl>()) {
+            sema.use(local);
             // if local lies in an outer function go through memory to implement closure
             if (local->is_mut() && local->fn() != sema.cur_fn_)
                 local->take_address();
         }
-    } else
+    } else if (!const_param())
         error(this, "expected value but found '{}'", path());
 }
 
@@ -341,16 +441,21 @@ void PrefixExpr::check(TypeSema& sema) const {
     switch (tag()) {
         case AND:
             rhs()->take_address();
+            sema.escape(rhs());
+            sema.no_soa_address(rhs(), "operand of '&'");
             return;
         case MUT:
             rhs()->write();
             rhs()->take_address();
+            sema.escape(rhs());
             sema.expect_lvalue(rhs(), "operand of '&mut'");
+            sema.no_soa_address(rhs(), "operand of '&mut'");
             return;
         case TILDE:
             return;
         case MUL:
             sema.expect_ptr(rhs(), "operand of unary '*'");
+            sema.access_in_place(rhs());
             return;
         case INC: case DEC: {
             rhs()->write();
@@ -495,6 +600,11 @@ void CastExpr::check(TypeSema& sema) const {
 
     if (src_type->is_known() && dst_type->is_known() && !valid_cast && !is_subtype(dst_type, src_type))
         error(this, "invalid source and destination types for cast operator, got '{}' and '{}'", src_type, dst_type);
+
+    // pointers to struct-of-arrays are lowered to one pointer per field and cannot be reinterpreted
+    auto soa_ptr = [&] (const Type* a) { return a->isa<PtrType>() && soa_struct_type(a->as<PtrType>()->pointee()); };
+    if (valid_cast && (soa_ptr(src_type) || soa_ptr(dst_type)) && !is_subtype(dst_type, src_type))
+        error(this, "invalid cast from '{}' to '{}' for pointers to struct-of-arrays", src_type, dst_type);
 }
 
 void ExplicitCastExpr::check(TypeSema& sema) const {
@@ -578,6 +688,7 @@ void StructExpr::check(TypeSema& sema) const {
 
 void FieldExpr::check(TypeSema& sema) const {
     auto type = unpack_ref_type(sema.check(lhs()));
+    sema.access_in_place(lhs());
 
     if (auto struct_type = type->isa<StructType>()) {
         auto struct_decl = struct_type->struct_decl();
@@ -589,7 +700,19 @@ void FieldExpr::check(TypeSema& sema) const {
         error(lhs(), "request for field '{}' in something not a structure", symbol());
 }
 
-void TypeAppExpr::check(TypeSema& /*sema*/) const {
+void TypeAppExpr::check(TypeSema& sema) const {
+    // inference does not distinguish types from dimensions - check the kinds of explicit arguments here
+    auto path_expr = lhs()->isa<PathExpr>();
+    auto fn_decl = path_expr && path_expr->value_decl() ? path_expr->value_decl()->isa<FnDecl>() : nullptr;
+    if (fn_decl == nullptr)
+        return;
+
+    for (size_t i = 0, e = std::min(num_ast_type_args(), fn_decl->num_ast_type_params()); i != e; ++i) {
+        if (fn_decl->ast_type_param(i)->is_const())
+            sema.check_dim(ast_type_arg(i), "argument of const type parameter");
+        else
+            sema.check(ast_type_arg(i));
+    }
 }
 
 void MapExpr::check(TypeSema& sema) const {
@@ -601,9 +724,11 @@ void MapExpr::check(TypeSema& sema) const {
     if (ltype->isa<FnType>()) {
         if (!type()->is_known())
             error(this, "cannot infer type for function call");
+        sema.check_simd_builtin(this);
         return sema.check_call(lhs(), args());
     }
 
+    sema.access_in_place(lhs());
     if (ltype->isa<ArrayType>()) {
         if (num_args() == 1)
             sema.expect_int(arg(0), "for array subscript");
@@ -637,6 +762,75 @@ void TypeSema::check_call(const Expr* expr, ArrayRef<const Expr*> args) {
               args.size(), std::max(size_t(0), fn_type->num_params() - (fn_type->is_returning() ? 1 : 0)));
 }
 
+void TypeSema::check_simd_builtin(const MapExpr* map_expr) {
+    auto intrinsic = map_expr->intrinsic();
+    if (intrinsic < Intrinsic::Shuffle || intrinsic >= Intrinsic::Num)
+        return;
+    auto& name = intrinsic_info(intrinsic).name;
+
+    // expects a simd vector with dim lanes - any number of lanes if dim is nullptr
+    auto simd_arg = [&] (size_t i, const Type* dim, const char* what) -> const SimdType* {
+        auto type = unpack_ref_type(map_expr->arg(i)->type());
+        auto simd_type = type->isa<SimdType>();
+        if (simd_type && (dim == nullptr || simd_type->dim_type() == dim))
+            return simd_type;
+        if (!type->isa<TypeError>() && type->is_known()) {
+            if (dim == nullptr)
+                error(map_expr->arg(i), "expected simd vector as {} of '{}' but found '{}'", what, name, type);
+            else
+                error(map_expr->arg(i), "expected simd vector with {} lanes as {} of '{}' but found '{}'", dim, what, name, type);
+        }
+        return nullptr;
+    };
+    auto mask_arg = [&] (size_t i, const Type* dim) {
+        if (simd_arg(i, dim, "mask"))
+            expect_bool(map_expr->arg(i), "mask of '{}'", name);
+    };
+
+    auto num_args = map_expr->num_args();
+    switch (intrinsic) {
+        case Intrinsic::ReduceAdd: case Intrinsic::ReduceMul: case Intrinsic::ReduceMin: case Intrinsic::ReduceMax:
+        case Intrinsic::ReduceAnd: case Intrinsic::ReduceOr:  case Intrinsic::ReduceXor:
+            if (num_args == 1)
+                simd_arg(0, nullptr, "operand");
+            break;
+        case Intrinsic::Any: case Intrinsic::All:
+            if (num_args == 1)
+                mask_arg(0, nullptr);
+            break;
+        case Intrinsic::Shuffle:
+            if (num_args == 3) {
+                if (auto simd_type = simd_arg(0, nullptr, "first operand")) {
+                    if (simd_arg(2, simd_type->dim_type(), "lane indices"))
+                        expect_int(map_expr->arg(2), "lane indices of '{}'", name);
+                }
+            }
+            break;
+        case Intrinsic::MaskedLoad: case Intrinsic::MaskedStore:
+            if (num_args == 3) {
+                expect_ptr(map_expr->arg(0), "address of '{}'", name);
+                if (auto simd_type = simd_arg(2, nullptr, "value"))
+                    mask_arg(1, simd_type->dim_type());
+            }
+            break;
+        case Intrinsic::Gather: case Intrinsic::Scatter: {
+            bool scatter = intrinsic == Intrinsic::Scatter;
+            if (num_args == (scatter ? 4u : 3u)) {
+                expect_ptr(map_expr->arg(0), "base address of '{}'", name);
+                if (auto index_type = simd_arg(1, nullptr, "lane indices")) {
+                    expect_int(map_expr->arg(1), "lane indices of '{}'", name);
+                    if (scatter)
+                        simd_arg(2, index_type->dim_type(), "value");
+                    mask_arg(num_args - 1, index_type->dim_type());
+                }
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
 void BlockExpr::check(TypeSema& sema) const {
     THORIN_PUSH(sema.cur_block_, this);
     for (auto&& stmt : stmts())
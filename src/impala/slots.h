@@ -0,0 +1,94 @@
+#ifndef IMPALA_SLOTS_H
+#define IMPALA_SLOTS_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+
+namespace impala {
+
+/**
+ * Growable array of @c std::unique_ptr used for the child lists of AST nodes.
+ * While the parser fills it, it grows like a @c std::vector.
+ * Move-constructing a @p Slots trims the storage to the exact number of elements;
+ * AST nodes adopt their lists this way and never modify them afterwards,
+ * so the address of each slot stays fixed as required by @p Expr::back_ref_.
+ * In contrast to a @c std::deque, this costs 16 bytes plus one pointer per element.
+ */
+template<class T>
+class Slots {
+public:
+    typedef std::unique_ptr<T> value_type;
+    typedef value_type* iterator;
+    typedef const value_type* const_iterator;
+
+    Slots() = default;
+    Slots(const Slots&) = delete;
+    Slots(Slots&& other)
+        : size_(other.size_)
+        , capacity_(other.size_)
+    {
+        if (other.size_ == other.capacity_) {
+            data_ = std::move(other.data_);
+        } else if (size_ != 0) {
+            data_.reset(new value_type[size_]);
+            std::move(other.begin(), other.end(), begin());
+            other.data_.reset();
+        }
+        other.size_ = other.capacity_ = 0;
+    }
+
+    Slots& operator=(Slots other) {
+        swap(*this, other);
+        return *this;
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    iterator begin() { return data_.get(); }
+    iterator end() { return data_.get() + size_; }
+    const_iterator begin() const { return data_.get(); }
+    const_iterator end() const { return data_.get() + size_; }
+
+    value_type& operator[](size_t i) { assert(i < size_); return data_[i]; }
+    const value_type& operator[](size_t i) const { assert(i < size_); return data_[i]; }
+    value_type& front() { return (*this)[0]; }
+    const value_type& front() const { return (*this)[0]; }
+    value_type& back() { return (*this)[size_ - 1]; }
+    const value_type& back() const { return (*this)[size_ - 1]; }
+
+    /// May move all slots - only use before any @p Expr::back_ref_ points into this container.
+    template<class... Args>
+    value_type& emplace_back(Args&&... args) {
+        if (size_ == capacity_)
+            grow();
+        data_[size_] = value_type(std::forward<Args>(args)...);
+        return data_[size_++];
+    }
+    void push_back(value_type&& value) { emplace_back(std::move(value)); }
+
+    friend void swap(Slots& a, Slots& b) {
+        using std::swap;
+        swap(a.data_, b.data_);
+        swap(a.size_, b.size_);
+        swap(a.capacity_, b.capacity_);
+    }
+
+private:
+    void grow() {
+        capacity_ = capacity_ == 0 ? 4 : 2 * capacity_;
+        std::unique_ptr<value_type[]> data(new value_type[capacity_]);
+        std::move(begin(), end(), data.get());
+        data_ = std::move(data);
+    }
+
+    std::unique_ptr<value_type[]> data_;
+    uint32_t size_ = 0;
+    uint32_t capacity_ = 0;
+};
+
+}
+
+#endif
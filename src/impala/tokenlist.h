@@ -79,6 +79,7 @@ IMPALA_INFIX(    AS, "as",     As)
 #define IMPALA_KEY(tok, str)
 #endif
 
+IMPALA_KEY(CONST,     "const")
 IMPALA_KEY(DO,        "do")
 IMPALA_KEY(ELSE,      "else")
 IMPALA_KEY(ENUM,      "enum")
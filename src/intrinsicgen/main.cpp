@@ -1,13 +1,22 @@
+#include <cstdlib>
 #include <iostream>
 
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
 #include <llvm/IR/Type.h>
+#include <llvm/IR/Verifier.h>
 
+#include "impala/args.h"
 #include "impala/ast.h"
 #include "impala/impala.h"
 
+typedef std::vector<std::string> Names;
+
 // extract intrinsic names for overloaded intrinsics
 static const char * const IntrinsicNameTable[] = {
   "not_intrinsic",
@@ -17,8 +26,33 @@ static const char * const IntrinsicNameTable[] = {
 };
 
 const impala::Type* llvm2impala(impala::TypeTable&, llvm::Type*);
+std::vector<llvm::Type*> overload_types(llvm::LLVMContext&, llvm::Intrinsic::ID, const Names&, const std::vector<unsigned>&);
+bool is_valid_instance(llvm::LLVMContext&, llvm::Intrinsic::ID, llvm::Type*);
+std::string mangle(llvm::Type*);
+
+int main(int argc, char** argv) {
+    Names elem_types, widths;
+    impala::ArgParser().option()
+        .add_option<Names>("types",  "<args>", "element types for which overloaded intrinsics are instantiated", elem_types, {"i32", "i64", "f32", "f64"})
+        .add_option<Names>("widths", "<args>", "vector widths for which overloaded intrinsics are instantiated", widths, {"2", "4", "8", "16"})
+        .parse(argc, argv);
+
+    std::vector<unsigned> vector_widths;
+    for (auto& width : widths) {
+        size_t end = 0;
+        unsigned long n = 0;
+        try {
+            n = std::stoul(width, &end);
+        } catch (const std::exception&) {
+            end = 0;
+        }
+        if (end == 0 || end != width.size() || n < 2 || n > 1024) {
+            std::cerr << "invalid vector width: " << width << std::endl;
+            return EXIT_FAILURE;
+        }
+        vector_widths.push_back(n);
+    }
 
-int main() {
     impala::init();
     std::unique_ptr<impala::TypeTable> typetable;
 
@@ -47,10 +81,8 @@ int main() {
         // replace '.' with '_'
         std::transform(name.begin(), name.end(), name.begin(), [] (char c) { return c == '.' ? '_' : c; });
 
-        if (llvm::Intrinsic::isOverloaded(id)) {
-            s.fmt("\n//fn \"{}\" {} is overloaded", llvm_name, name);
-        } else {
-            if (auto itype = llvm2impala(*typetable, llvm::Intrinsic::getType(context, id))) {
+        auto declare = [&] (const std::string& llvm_name, const std::string& name, llvm::ArrayRef<llvm::Type*> types) {
+            if (auto itype = llvm2impala(*typetable, llvm::Intrinsic::getType(context, id, types))) {
                 s.endl();
                 auto fn = itype->as<impala::FnType>();
                 s.fmt("fn \"{}\" {} (", llvm_name, name);
@@ -64,6 +96,18 @@ int main() {
                 else
                     s.fmt(") -> {};", fn->return_type());
             }
+        };
+
+        if (llvm::Intrinsic::isOverloaded(id)) {
+            auto types = overload_types(context, id, elem_types, vector_widths);
+            if (types.empty())
+                s.fmt("\n//fn \"{}\" {} is overloaded", llvm_name, name);
+            for (auto type : types) {
+                auto suffix = mangle(type);
+                declare(llvm_name + "." + suffix, name + "_" + suffix, { type });
+            }
+        } else {
+            declare(llvm_name, name, {});
         }
     }
 
@@ -126,3 +170,117 @@ const impala::Type* llvm2impala(impala::TypeTable& tt, llvm::Type* type) {
 
     return nullptr;
 }
+
+/// Instances of the overloaded intrinsic @p id with a single overloaded type built from @p elem_types and @p widths.
+std::vector<llvm::Type*> overload_types(llvm::LLVMContext& context, llvm::Intrinsic::ID id, const Names& elem_types, const std::vector<unsigned>& widths) {
+    using llvm::Intrinsic::IITDescriptor;
+
+    llvm::SmallVector<IITDescriptor, 8> table;
+    llvm::Intrinsic::getIntrinsicInfoTableEntries(id, table);
+
+    unsigned num_overloads = 0;
+    bool int_only = false, float_only = false, vector_only = false;
+    for (auto& descriptor : table) {
+        switch (descriptor.Kind) {
+            case IITDescriptor::Argument:
+                num_overloads = std::max(num_overloads, descriptor.getArgumentNumber() + 1);
+                switch (descriptor.getArgumentKind()) {
+                    case IITDescriptor::AK_AnyInteger: int_only    = true; break;
+                    case IITDescriptor::AK_AnyFloat:   float_only  = true; break;
+                    case IITDescriptor::AK_AnyVector:  vector_only = true; break;
+                    case IITDescriptor::AK_AnyPointer: return {};
+                    default: break;
+                }
+                break;
+            // derived types which only exist for vectors
+            case IITDescriptor::HalfVecArgument:
+            case IITDescriptor::SameVecWidthArgument:
+            case IITDescriptor::VecElementArgument:
+            case IITDescriptor::Subdivide2Argument:
+            case IITDescriptor::Subdivide4Argument:
+            case IITDescriptor::VecOfBitcastsToInt:
+                vector_only = true;
+                break;
+            case IITDescriptor::VecOfAnyPtrsToElt:
+                return {};
+            default:
+                break;
+        }
+    }
+
+    // intrinsics overloaded on several types are left out
+    if (num_overloads != 1)
+        return {};
+
+    std::vector<llvm::Type*> result;
+    for (auto& elem_type : elem_types) {
+        llvm::Type* elem = nullptr;
+        if (elem_type == "i1" || elem_type == "bool") elem = llvm::Type::getInt1Ty(context);
+        else if (elem_type == "i8")  elem = llvm::Type::getInt8Ty(context);
+        else if (elem_type == "i16") elem = llvm::Type::getInt16Ty(context);
+        else if (elem_type == "i32") elem = llvm::Type::getInt32Ty(context);
+        else if (elem_type == "i64") elem = llvm::Type::getInt64Ty(context);
+        else if (elem_type == "f16") elem = llvm::Type::getHalfTy(context);
+        else if (elem_type == "f32") elem = llvm::Type::getFloatTy(context);
+        else if (elem_type == "f64") elem = llvm::Type::getDoubleTy(context);
+        else {
+            std::cerr << "unknown element type: " << elem_type << std::endl;
+            continue;
+        }
+
+        if ((int_only && !elem->isIntegerTy()) || (float_only && !elem->isFloatingPointTy()))
+            continue;
+
+        // llvm_anyvector_ty does not tell integer from floating-point vectors - only the verifier does
+        if (!vector_only && is_valid_instance(context, id, elem))
+            result.push_back(elem);
+        for (auto width : widths) {
+            auto type = llvm::FixedVectorType::get(elem, width);
+            if (is_valid_instance(context, id, type))
+                result.push_back(type);
+        }
+    }
+
+    return result;
+}
+
+/// Whether the verifier accepts a call of the intrinsic @p id instantiated for @p type, e.g. @c llvm.vector.reduce.fadd only for floating-point vectors.
+bool is_valid_instance(llvm::LLVMContext& context, llvm::Intrinsic::ID id, llvm::Type* type) {
+    llvm::Module module("instance", context);
+    auto callee = llvm::Intrinsic::getDeclaration(&module, id, { type });
+    auto fn_type = callee->getFunctionType();
+    // such intrinsics cannot be declared in Impala anyway
+    for (auto param : fn_type->params()) {
+        if (param->isMetadataTy() || param->isTokenTy())
+            return true;
+    }
+
+    auto caller = llvm::Function::Create(llvm::FunctionType::get(llvm::Type::getVoidTy(context), fn_type->params(), false),
+                                         llvm::Function::ExternalLinkage, "caller", module);
+    llvm::IRBuilder<> builder(llvm::BasicBlock::Create(context, "entry", caller));
+    std::vector<llvm::Value*> args;
+    for (unsigned i = 0, e = fn_type->getNumParams(); i != e; ++i) {
+        auto param = fn_type->getParamType(i);
+        // immediates must be constants; 1 passes as alignment, too
+        if (callee->hasParamAttribute(i, llvm::Attribute::ImmArg))
+            args.push_back(param->isIntegerTy() ? llvm::ConstantInt::get(param, 1) : llvm::Constant::getNullValue(param));
+        else
+            args.push_back(caller->getArg(i));
+    }
+    builder.CreateCall(callee, args);
+    builder.CreateRetVoid();
+
+    return !llvm::verifyModule(module);
+}
+
+/// Suffix LLVM appends to the name of an overloaded intrinsic for @p type.
+std::string mangle(llvm::Type* type) {
+    if (auto vector_type = llvm::dyn_cast<llvm::FixedVectorType>(type))
+        return "v" + std::to_string(vector_type->getNumElements()) + mangle(vector_type->getElementType());
+    if (type->isIntegerTy()) return "i" + std::to_string(type->getIntegerBitWidth());
+    if (type->isHalfTy())    return "f16";
+    if (type->isFloatTy())   return "f32";
+    if (type->isDoubleTy())  return "f64";
+    assert(false && "unsupported overload type");
+    return "";
+}
@@ -0,0 +1,231 @@
+#ifndef IMPALA_LSP_JSON_H
+#define IMPALA_LSP_JSON_H
+
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace impala::lsp {
+
+/// Minimal JSON value - just enough for the language server protocol.
+class Json {
+public:
+    enum Tag { Null, Bool, Number, String, Array, Object };
+
+    Json() {}
+    Json(std::nullptr_t) {}
+    Json(bool b) : tag_(Bool), bool_(b) {}
+    Json(int n) : tag_(Number), number_(n) {}
+    Json(size_t n) : tag_(Number), number_(double(n)) {}
+    Json(double n) : tag_(Number), number_(n) {}
+    Json(const char* s) : tag_(String), string_(s) {}
+    Json(std::string s) : tag_(String), string_(std::move(s)) {}
+
+    static Json array() { Json j; j.tag_ = Array; return j; }
+    static Json object() { Json j; j.tag_ = Object; return j; }
+
+    Tag tag() const { return tag_; }
+    bool is_null() const { return tag_ == Null; }
+    bool as_bool() const { return tag_ == Bool && bool_; }
+    double as_number() const { return tag_ == Number ? number_ : 0; }
+    int as_int() const { return int(as_number()); }
+    const std::string& as_string() const { return string_; }
+    const std::vector<Json>& elems() const { return array_; }
+
+    /// Member @p key or @c null.
+    const Json& operator[](const std::string& key) const {
+        static const Json null;
+        auto i = object_.find(key);
+        return i == object_.end() ? null : i->second;
+    }
+    Json& operator[](const std::string& key) { tag_ = Object; return object_[key]; }
+    bool has(const std::string& key) const { return object_.count(key) != 0; }
+    void push_back(Json elem) { tag_ = Array; array_.push_back(std::move(elem)); }
+
+    static Json parse(const std::string& str) {
+        size_t i = 0;
+        auto result = parse(str, i);
+        skip_space(str, i);
+        if (i != str.size())
+            throw std::runtime_error("trailing characters after JSON value");
+        return result;
+    }
+
+    void dump(std::ostream& o) const {
+        switch (tag_) {
+            case Null:   o << "null"; break;
+            case Bool:   o << (bool_ ? "true" : "false"); break;
+            case Number: {
+                if (number_ == double(int64_t(number_)))
+                    o << int64_t(number_);
+                else
+                    o << number_;
+                break;
+            }
+            case String: dump_string(o, string_); break;
+            case Array: {
+                o << '[';
+                for (size_t i = 0; i != array_.size(); ++i) {
+                    if (i != 0) o << ',';
+                    array_[i].dump(o);
+                }
+                o << ']';
+                break;
+            }
+            case Object: {
+                o << '{';
+                bool first = true;
+                for (auto& p : object_) {
+                    if (!first) o << ',';
+                    first = false;
+                    dump_string(o, p.first);
+                    o << ':';
+                    p.second.dump(o);
+                }
+                o << '}';
+                break;
+            }
+        }
+    }
+
+private:
+    static void skip_space(const std::string& s, size_t& i) {
+        while (i < s.size() && (s[i] == ' ' || s[i] == '\t' || s[i] == '\n' || s[i] == '\r'))
+            ++i;
+    }
+
+    static void expect(const std::string& s, size_t& i, const char* word) {
+        for (; *word; ++word, ++i) {
+            if (i >= s.size() || s[i] != *word)
+                throw std::runtime_error("malformed JSON");
+        }
+    }
+
+    static Json parse(const std::string& s, size_t& i) {
+        skip_space(s, i);
+        if (i >= s.size())
+            throw std::runtime_error("unexpected end of JSON");
+
+        switch (s[i]) {
+            case 'n': expect(s, i, "null");  return Json();
+            case 't': expect(s, i, "true");  return Json(true);
+            case 'f': expect(s, i, "false"); return Json(false);
+            case '"': return Json(parse_string(s, i));
+            case '[': {
+                auto result = array();
+                ++i;
+                skip_space(s, i);
+                if (i < s.size() && s[i] == ']') { ++i; return result; }
+                while (true) {
+                    result.push_back(parse(s, i));
+                    skip_space(s, i);
+                    if (i < s.size() && s[i] == ',') { ++i; continue; }
+                    expect(s, i, "]");
+                    return result;
+                }
+            }
+            case '{': {
+                auto result = object();
+                ++i;
+                skip_space(s, i);
+                if (i < s.size() && s[i] == '}') { ++i; return result; }
+                while (true) {
+                    skip_space(s, i);
+                    auto key = parse_string(s, i);
+                    skip_space(s, i);
+                    expect(s, i, ":");
+                    result[key] = parse(s, i);
+                    skip_space(s, i);
+                    if (i < s.size() && s[i] == ',') { ++i; continue; }
+                    expect(s, i, "}");
+                    return result;
+                }
+            }
+            default: {
+                size_t end;
+                auto n = std::stod(s.substr(i, 32), &end);
+                i += end;
+                return Json(n);
+            }
+        }
+    }
+
+    static std::string parse_string(const std::string& s, size_t& i) {
+        expect(s, i, "\"");
+        std::string result;
+        while (i < s.size() && s[i] != '"') {
+            char c = s[i++];
+            if (c != '\\') {
+                result += c;
+                continue;
+            }
+            if (i >= s.size())
+                break;
+            switch (c = s[i++]) {
+                case 'n': result += '\n'; break;
+                case 't': result += '\t'; break;
+                case 'r': result += '\r'; break;
+                case 'b': result += '\b'; break;
+                case 'f': result += '\f'; break;
+                case 'u': {
+                    unsigned code = std::stoul(s.substr(i, 4), nullptr, 16);
+                    i += 4;
+                    // encode as UTF-8; surrogate pairs are not combined
+                    if (code < 0x80) {
+                        result += char(code);
+                    } else if (code < 0x800) {
+                        result += char(0xC0 | (code >> 6));
+                        result += char(0x80 | (code & 0x3F));
+                    } else {
+                        result += char(0xE0 | (code >> 12));
+                        result += char(0x80 | ((code >> 6) & 0x3F));
+                        result += char(0x80 | (code & 0x3F));
+                    }
+                    break;
+                }
+                default: result += c; break;
+            }
+        }
+        expect(s, i, "\"");
+        return result;
+    }
+
+    static void dump_string(std::ostream& o, const std::string& str) {
+        o << '"';
+        for (unsigned char c : str) {
+            switch (c) {
+                case '"':  o << "\\\""; break;
+                case '\\': o << "\\\\"; break;
+                case '\n': o << "\\n";  break;
+                case '\r': o << "\\r";  break;
+                case '\t': o << "\\t";  break;
+                default:
+                    if (c < 0x20) {
+                        char buf[8];
+                        std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                        o << buf;
+                    } else {
+                        o << c;
+                    }
+            }
+        }
+        o << '"';
+    }
+
+    Tag tag_ = Null;
+    bool bool_ = false;
+    double number_ = 0;
+    std::string string_;
+    std::vector<Json> array_;
+    std::map<std::string, Json> object_;
+};
+
+inline std::ostream& operator<<(std::ostream& o, const Json& json) { json.dump(o); return o; }
+
+}
+
+#endif
@@ -0,0 +1,554 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+#include "impala/args.h"
+#include "impala/ast.h"
+#include "impala/impala.h"
+
+#include "lsp/json.h"
+
+// Language server for Impala speaking LSP over stdin/stdout.
+// Documents are split into top-level items; an edit re-parses only the items whose text changed
+// and publishes their syntax errors right away. Name binding and type inference work on the whole
+// module, so the full check runs once no further messages are pending or a query needs its results.
+
+using namespace impala;
+using impala::lsp::Json;
+
+typedef std::vector<std::string> Names;
+
+//------------------------------------------------------------------------------
+
+struct Chunk {
+    std::string text;
+    Pos begin;
+    std::vector<Json> diagnostics; ///< syntax errors
+};
+
+struct Document {
+    std::string uri;
+    std::string path;
+    std::string text;
+    std::vector<Chunk> chunks;
+
+    // results of the last full check - valid if @p checked
+    bool checked = false;
+    std::unique_ptr<TypeTable> typetable;
+    std::unique_ptr<const Module> module;
+    Index index;
+    std::vector<Json> diagnostics;
+};
+
+static Json position(Pos pos) {
+    auto result = Json::object();
+    result["line"] = int(pos.row) - 1;
+    result["character"] = int(pos.col) - 1;
+    return result;
+}
+
+/// Internally, the @c character of positions counts bytes like the columns of Impala's @c Loc - see @c Server::encode.
+static Json range(const Loc& loc) {
+    auto result = Json::object();
+    result["start"] = position(loc.begin);
+    result["end"] = position({loc.finis.row, loc.finis.col + 1}); // LSP ranges exclude their end
+    return result;
+}
+
+static bool contains(const Loc& loc, Pos pos) {
+    auto le = [] (Pos a, Pos b) { return a.row < b.row || (a.row == b.row && a.col <= b.col); };
+    return le(loc.begin, pos) && le(pos, loc.finis);
+}
+
+static bool smaller(const Loc& a, const Loc& b) {
+    return a.finis.row - a.begin.row < b.finis.row - b.begin.row
+        || (a.finis.row - a.begin.row == b.finis.row - b.begin.row && a.finis.col - a.begin.col < b.finis.col - b.begin.col);
+}
+
+/// Runs @p f and collects all diagnostics reported meanwhile.
+template<class F>
+static std::vector<Json> collect_diagnostics(F f) {
+    std::vector<Json> result;
+    diagnostic_handler() = [&] (const Loc& loc, bool error, const std::string& msg) {
+        auto diagnostic = Json::object();
+        diagnostic["range"] = range(loc);
+        diagnostic["severity"] = error ? 1 : 2;
+        diagnostic["source"] = "impala";
+        diagnostic["message"] = msg;
+        result.push_back(diagnostic);
+    };
+    num_errors() = num_warnings() = 0;
+    f();
+    diagnostic_handler() = nullptr;
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+/*
+ * splitting documents into items
+ */
+
+/// Does an item start at @p i (after skipping whitespace) - or a comment, which precedes one?
+static bool item_follows(const std::string& text, size_t i) {
+    static const char* keywords[] = { "fn", "struct", "enum", "static", "extern", "impl", "mod", "trait", "type", "typedef", "pub", "priv" };
+    while (i < text.size() && std::isspace((unsigned char) text[i]))
+        ++i;
+    if (i == text.size() || text[i] == '/')
+        return true;
+    size_t end = i;
+    while (end < text.size() && (std::isalnum((unsigned char) text[end]) || text[end] == '_'))
+        ++end;
+    auto word = text.substr(i, end - i);
+    return std::find(std::begin(keywords), std::end(keywords), word) != std::end(keywords);
+}
+
+/**
+ * Splits @p text into top-level items: after each @c ; and after each @c } followed by another item,
+ * both outside of parentheses, brackets, braces, strings and comments.
+ */
+static std::vector<Chunk> split(const std::string& text) {
+    std::vector<Chunk> chunks;
+    Pos pos = {1, 1}, begin = pos;
+    size_t start = 0;
+    int depth = 0;
+
+    for (size_t i = 0, e = text.size(); i < e; ++i) {
+        char c = text[i];
+        auto advance = [&] () {
+            if (text[i] == '\n') { ++pos.row; pos.col = 1; } else { ++pos.col; }
+        };
+
+        if (c == '/' && i + 1 < e && text[i + 1] == '/') {
+            while (i < e && text[i] != '\n') { advance(); ++i; }
+            if (i < e) advance();
+            continue;
+        }
+        if (c == '/' && i + 1 < e && text[i + 1] == '*') {
+            advance(); ++i;
+            while (i + 1 < e && !(text[i] == '*' && text[i + 1] == '/')) { advance(); ++i; }
+            if (i + 1 < e) { advance(); ++i; advance(); }
+            continue;
+        }
+        if (c == '"' || c == '\'') {
+            advance();
+            for (++i; i < e && text[i] != c; ++i) {
+                if (text[i] == '\\' && i + 1 < e) { advance(); ++i; }
+                advance();
+            }
+            if (i < e) advance();
+            continue;
+        }
+
+        advance();
+        if (c == '(' || c == '[' || c == '{') ++depth;
+        if (c == ')' || c == ']' || c == '}') depth = std::max(0, depth - 1);
+        if (depth == 0 && (c == ';' || (c == '}' && item_follows(text, i + 1)))) {
+            chunks.push_back({text.substr(start, i + 1 - start), begin, {}});
+            start = i + 1;
+            begin = pos;
+        }
+    }
+    if (start != text.size())
+        chunks.push_back({text.substr(start), begin, {}});
+    return chunks;
+}
+
+static std::vector<Json> parse_chunk(const Document& doc, const Chunk& chunk) {
+    return collect_diagnostics([&] {
+        Items items;
+        std::istringstream is(chunk.text);
+        parse(items, is, doc.path.c_str(), chunk.begin);
+    });
+}
+
+/// Moves the diagnostics of @p chunk from its old position @p from to its current one.
+static void move_diagnostics(Chunk& chunk, Pos from) {
+    auto move = [&] (Json& p) {
+        auto line = p["line"].as_int();
+        if (line == int(from.row) - 1)
+            p["character"] = p["character"].as_int() + int(chunk.begin.col) - int(from.col);
+        p["line"] = line + int(chunk.begin.row) - int(from.row);
+    };
+    for (auto& diagnostic : chunk.diagnostics) {
+        move(diagnostic["range"]["start"]);
+        move(diagnostic["range"]["end"]);
+    }
+}
+
+/// Re-parses the items of @p doc whose text changed; the others keep their diagnostics.
+static void update_chunks(Document& doc) {
+    std::unordered_map<std::string, Chunk*> old_chunks;
+    for (auto& chunk : doc.chunks)
+        old_chunks.emplace(chunk.text, &chunk);
+
+    auto chunks = split(doc.text);
+    for (auto& chunk : chunks) {
+        auto i = old_chunks.find(chunk.text);
+        if (i == old_chunks.end()) {
+            chunk.diagnostics = parse_chunk(doc, chunk);
+        } else {
+            chunk.diagnostics = std::move(i->second->diagnostics);
+            move_diagnostics(chunk, i->second->begin);
+            old_chunks.erase(i);
+        }
+    }
+    doc.chunks = std::move(chunks);
+    doc.checked = false;
+}
+
+static void check(Document& doc) {
+    if (doc.checked)
+        return;
+
+    // the index refers to the old module
+    doc.index = Index();
+    doc.module.reset();
+    doc.typetable.reset();
+
+    doc.diagnostics = collect_diagnostics([&] {
+        Items items;
+        std::istringstream is(doc.text);
+        parse(items, is, doc.path.c_str());
+        doc.module = std::make_unique<const Module>(doc.path.c_str(), std::move(items));
+
+        index() = &doc.index;
+        impala::check(doc.typetable, doc.module.get());
+        index() = nullptr;
+    });
+    doc.checked = true;
+}
+
+//------------------------------------------------------------------------------
+
+/*
+ * server
+ */
+
+class Server {
+public:
+    Server(std::ostream& out)
+        : out_(out)
+    {}
+
+    bool done() const { return exit_; }
+
+    /// Handles a message and returns the response or @c null for notifications.
+    Json handle(const Json& msg) {
+        auto& method = msg["method"].as_string();
+        auto& params = msg["params"];
+        Json result;
+
+        if (method == "initialize") {
+            auto capabilities = Json::object();
+            auto sync = Json::object();
+            sync["openClose"] = true;
+            sync["change"] = 2; // incremental
+            sync["save"] = true;
+            capabilities["textDocumentSync"] = sync;
+            capabilities["hoverProvider"] = true;
+            capabilities["definitionProvider"] = true;
+            // positions count UTF-16 code units unless the client also takes bytes
+            for (auto& encoding : params["capabilities"]["general"]["positionEncodings"].elems()) {
+                if (encoding.as_string() == "utf-8")
+                    utf8_ = true;
+            }
+            capabilities["positionEncoding"] = utf8_ ? "utf-8" : "utf-16";
+            result["capabilities"] = capabilities;
+            result["serverInfo"]["name"] = "impala-lsp";
+        } else if (method == "shutdown") {
+            result = nullptr;
+        } else if (method == "exit") {
+            exit_ = true;
+        } else if (method == "textDocument/didOpen") {
+            auto& item = params["textDocument"];
+            auto& doc = docs_[item["uri"].as_string()];
+            doc.uri = item["uri"].as_string();
+            doc.path = doc.uri.compare(0, 7, "file://") == 0 ? doc.uri.substr(7) : doc.uri;
+            doc.text = item["text"].as_string();
+            edited(doc);
+        } else if (method == "textDocument/didChange") {
+            if (auto doc = find(params)) {
+                for (auto& change : params["contentChanges"].elems())
+                    apply(*doc, change);
+                edited(*doc);
+            }
+        } else if (method == "textDocument/didSave") {
+            if (auto doc = find(params)) {
+                check(*doc);
+                publish(*doc);
+            }
+        } else if (method == "textDocument/didClose") {
+            docs_.erase(params["textDocument"]["uri"].as_string());
+        } else if (method == "textDocument/hover") {
+            if (auto doc = find(params))
+                result = hover(*doc, pos(*doc, params));
+        } else if (method == "textDocument/definition") {
+            if (auto doc = find(params))
+                result = definition(*doc, pos(*doc, params));
+        } else if (msg.has("id")) {
+            auto error = Json::object();
+            error["code"] = -32601;
+            error["message"] = "method not found: " + method;
+            return response(msg, nullptr, error);
+        }
+
+        return msg.has("id") ? response(msg, result, nullptr) : Json();
+    }
+
+    /// Called when no further messages are pending: checks and publishes all edited documents.
+    void idle() {
+        for (auto& p : docs_) {
+            if (!p.second.checked) {
+                check(p.second);
+                publish(p.second);
+            }
+        }
+    }
+
+    void send(const Json& msg) {
+        std::ostringstream os;
+        os << msg;
+        auto str = os.str();
+        out_ << "Content-Length: " << str.size() << "\r\n\r\n" << str;
+        out_.flush();
+    }
+
+private:
+    static Json response(const Json& msg, Json result, Json error) {
+        auto response = Json::object();
+        response["jsonrpc"] = "2.0";
+        response["id"] = msg["id"];
+        if (error.is_null())
+            response["result"] = std::move(result);
+        else
+            response["error"] = std::move(error);
+        return response;
+    }
+
+    Document* find(const Json& params) {
+        auto i = docs_.find(params["textDocument"]["uri"].as_string());
+        return i == docs_.end() ? nullptr : &i->second;
+    }
+
+    /// Offset of line @p line - counted from 0 - in @p text or the size of @p text if it has fewer lines.
+    static size_t line_offset(const std::string& text, int line) {
+        size_t i = 0;
+        for (; line > 0 && i < text.size(); ++i) {
+            if (text[i] == '\n') --line;
+        }
+        return i;
+    }
+
+    /// Bytes of the UTF-8 sequence which starts with @p c - or 1 for any other byte.
+    static size_t utf8_length(char c) {
+        auto u = (unsigned char) c;
+        return u < 0xC0 ? 1 : u < 0xE0 ? 2 : u < 0xF0 ? 3 : 4;
+    }
+
+    /// Code units of the client's position encoding taken by the character which starts at @p i in @p text.
+    size_t units(const std::string& text, size_t i) const { return utf8_ ? 1 : utf8_length(text[i]) == 4 ? 2 : 1; }
+
+    /// Offset in @p text of the position @p p of the client - clamped to the end of its line.
+    size_t offset(const std::string& text, const Json& p) const {
+        size_t i = line_offset(text, p["line"].as_int());
+        for (int n = 0, character = p["character"].as_int(); n < character && i < text.size() && text[i] != '\n'; ) {
+            n += units(text, i);
+            i = std::min(text.size(), i + (utf8_ ? 1 : utf8_length(text[i])));
+        }
+        return i;
+    }
+
+    Pos pos(const Document& doc, const Json& params) const {
+        auto& p = params["position"];
+        auto line = p["line"].as_int();
+        return {uint32_t(line + 1), uint32_t(offset(doc.text, p) - line_offset(doc.text, line) + 1)};
+    }
+
+    /// Converts the @c character of the positions in @p range within @p doc from bytes to the position encoding of the client.
+    Json encode(const Document& doc, Json range) const {
+        if (utf8_)
+            return range;
+        for (auto key : { "start", "end" }) {
+            auto& p = range[key];
+            auto begin = line_offset(doc.text, p["line"].as_int());
+            int n = 0;
+            for (size_t i = begin, e = std::min(doc.text.size(), begin + p["character"].as_int()); i < e; i += utf8_length(doc.text[i]))
+                n += units(doc.text, i);
+            p["character"] = n;
+        }
+        return range;
+    }
+
+    void apply(Document& doc, const Json& change) const {
+        if (!change.has("range")) {
+            doc.text = change["text"].as_string();
+            return;
+        }
+        auto begin = offset(doc.text, change["range"]["start"]);
+        auto end   = offset(doc.text, change["range"]["end"]);
+        doc.text.replace(begin, end - begin, change["text"].as_string());
+    }
+
+    void edited(Document& doc) {
+        update_chunks(doc);
+        publish(doc);
+    }
+
+    /// Publishes the result of the last full check or the syntax errors if the document changed since.
+    void publish(const Document& doc) {
+        auto diagnostics = Json::array();
+        auto add = [&] (Json diagnostic) {
+            diagnostic["range"] = encode(doc, diagnostic["range"]);
+            diagnostics.push_back(std::move(diagnostic));
+        };
+        if (doc.checked) {
+            for (auto& diagnostic : doc.diagnostics)
+                add(diagnostic);
+        } else {
+            for (auto& chunk : doc.chunks) {
+                for (auto& diagnostic : chunk.diagnostics)
+                    add(diagnostic);
+            }
+        }
+
+        auto msg = Json::object();
+        msg["jsonrpc"] = "2.0";
+        msg["method"] = "textDocument/publishDiagnostics";
+        msg["params"]["uri"] = doc.uri;
+        msg["params"]["diagnostics"] = diagnostics;
+        send(msg);
+    }
+
+    Json hover(Document& doc, Pos pos) {
+        check(doc);
+
+        const Expr* best = nullptr;
+        for (auto expr : doc.index.exprs) {
+            if (expr->type() && contains(expr->loc(), pos) && (!best || smaller(expr->loc(), best->loc())))
+                best = expr;
+        }
+        if (!best)
+            return nullptr;
+
+        std::ostringstream os;
+        Stream(os).fmt("{}", best->type());
+        auto result = Json::object();
+        result["contents"]["kind"] = "plaintext";
+        result["contents"]["value"] = os.str();
+        result["range"] = encode(doc, range(best->loc()));
+        return result;
+    }
+
+    Json definition(Document& doc, Pos pos) {
+        check(doc);
+
+        const std::pair<Loc, const Decl*>* best = nullptr;
+        for (auto& use : doc.index.uses) {
+            if (contains(use.first, pos) && (!best || smaller(use.first, best->first)))
+                best = &use;
+        }
+        if (!best || best->second->loc().file != doc.path)
+            return nullptr;
+
+        auto result = Json::object();
+        result["uri"] = doc.uri;
+        result["range"] = encode(doc, range(best->second->loc()));
+        return result;
+    }
+
+    std::ostream& out_;
+    std::unordered_map<std::string, Document> docs_;
+    bool exit_ = false;
+    bool utf8_ = false; ///< negotiated position encoding: UTF-8 instead of UTF-16 code units
+};
+
+//------------------------------------------------------------------------------
+
+/// Reads a message framed by a @c Content-Length header; returns @c false at the end of input.
+static bool read_message(std::istream& in, std::string& content) {
+    size_t length = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty())
+            break;
+        if (line.compare(0, 15, "Content-Length:") == 0)
+            length = std::stoul(line.substr(15));
+    }
+    if (!in || length == 0)
+        return false;
+    content.resize(length);
+    return bool(in.read(&content[0], length));
+}
+
+/// Replays a trace with one client message per line and reports the time taken per message on @c std::cerr.
+static int replay(Server& server, const std::string& name) {
+    std::ifstream in(name);
+    if (!in)
+        throw std::runtime_error("cannot read '" + name + "'");
+
+    std::string line;
+    while (std::getline(in, line) && !server.done()) {
+        if (line.empty())
+            continue;
+        auto msg = Json::parse(line);
+        auto start = std::chrono::steady_clock::now();
+        auto response = server.handle(msg);
+        if (in.peek() == std::char_traits<char>::eof())
+            server.idle();
+        auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (!response.is_null())
+            server.send(response);
+        std::cerr << msg["method"].as_string() << ' ' << ms << " ms" << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+    try {
+        Names args;
+        std::string replay_name;
+        bool help;
+
+        auto cmd_parser = impala::ArgParser()
+            .implicit_option       (          "<ignored>", "arguments passed by editors, e.g. --stdio", args)
+            .add_option<bool>       ("help",   "",          "produce this help message", help, false)
+            .add_option<std::string>("replay", "<file>",    "replay a trace with one client message per line instead of serving stdin", replay_name, "");
+        cmd_parser.parse(argc, argv);
+
+        if (help) {
+            cmd_parser.print_help();
+            return EXIT_SUCCESS;
+        }
+
+        impala::init();
+        std::ios::sync_with_stdio(false);
+        Server server(std::cout);
+
+        if (!replay_name.empty())
+            return replay(server, replay_name);
+
+        std::string content;
+        while (!server.done() && read_message(std::cin, content)) {
+            auto response = server.handle(Json::parse(content));
+            if (!response.is_null())
+                server.send(response);
+            if (std::cin.rdbuf()->in_avail() == 0)
+                server.idle();
+        }
+    } catch (std::exception const& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    } catch (...) {
+        std::cerr << "unknown exception" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,69 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Runtime for code compiled with -fprofile-generate.
+// Each profiled site counts in a counter of its own which the generated code increments inline; each module registers
+// the table of its counters and their keys once via __impala_profile_register. Like gcov by default, the counters are
+// not incremented atomically: concurrent executions of the same site may lose counts.
+// Counts are written at exit to $IMPALA_PROFILE_FILE (default: impala.profdata)
+// as lines '<count> <key>' which can be fed back via -fprofile-use.
+
+namespace {
+
+struct Table {
+    const uint64_t* const* counters;
+    const char* const* keys;
+    uint32_t num_sites;
+};
+
+struct Profile {
+    void write() {
+        std::lock_guard<std::mutex> guard(mutex);
+
+        // specializations of a generic function count the same site in counters of their own
+        std::map<std::string, uint64_t> merged;
+        for (auto& table : tables) {
+            for (uint32_t i = 0; i != table.num_sites; ++i)
+                merged[table.keys[i]] += *table.counters[i];
+        }
+
+        auto name = std::getenv("IMPALA_PROFILE_FILE");
+        auto file = std::fopen(name ? name : "impala.profdata", "w");
+        if (!file)
+            return;
+        for (auto& p : merged)
+            std::fprintf(file, "%llu %s\n", (unsigned long long) p.second, p.first.c_str());
+        std::fclose(file);
+    }
+
+    std::mutex mutex;
+    std::vector<Table> tables;
+};
+
+// never destroyed - threads which outlive exit may still register their module
+Profile& profile() {
+    static Profile* profile = [] {
+        auto profile = new Profile();
+        std::atexit([] { ::profile().write(); });
+        return profile;
+    }();
+    return *profile;
+}
+
+}
+
+extern "C" void __impala_profile_register(const uint64_t* const* counters, const char* const* keys, uint32_t num_sites) {
+    auto& p = profile();
+    std::lock_guard<std::mutex> guard(p.mutex);
+    // threads racing into the first function of a module may both register it
+    for (auto& table : p.tables) {
+        if (table.counters == counters)
+            return;
+    }
+    p.tables.push_back({counters, keys, num_sites});
+}
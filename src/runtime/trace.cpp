@@ -0,0 +1,114 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Runtime for code compiled with -finstrument-functions.
+// Events are written at exit to $IMPALA_TRACE_FILE (default: impala_trace.json) in the Chrome trace event format.
+// Function names are taken from the table in $IMPALA_TRACE_MAP (the '<module>.tracemap' written by impala).
+// Events which threads record after the trace has been written are dropped.
+
+namespace {
+
+struct Event {
+    uint32_t id;
+    char phase;
+    int64_t ts;
+};
+
+struct Buffer {
+    size_t tid;
+    // only contended while the trace is written
+    std::mutex mutex;
+    std::vector<Event> events;
+};
+
+struct Trace {
+    Trace()
+        : start(std::chrono::steady_clock::now())
+    {}
+
+    void write() {
+        std::unordered_map<uint32_t, std::string> names;
+        if (auto map = std::getenv("IMPALA_TRACE_MAP")) {
+            std::ifstream in(map);
+            uint32_t id;
+            std::string name, loc;
+            while (in >> id >> name && std::getline(in, loc))
+                names[id] = name;
+        }
+
+        auto name = std::getenv("IMPALA_TRACE_FILE");
+        auto file = std::fopen(name ? name : "impala_trace.json", "w");
+        if (!file)
+            return;
+
+        // other threads may still run - stop them from recording before the buffers are read
+        std::lock_guard<std::mutex> guard(mutex);
+        done = true;
+        std::fprintf(file, "{\"traceEvents\":[");
+        const char* sep = "\n";
+        for (auto& buffer : buffers) {
+            std::lock_guard<std::mutex> buffer_guard(buffer->mutex);
+            for (auto& event : buffer->events) {
+                auto i = names.find(event.id);
+                if (i != names.end())
+                    std::fprintf(file, "%s{\"name\":\"%s\"", sep, i->second.c_str());
+                else
+                    std::fprintf(file, "%s{\"name\":\"%u\"", sep, (unsigned) event.id);
+                std::fprintf(file, ",\"ph\":\"%c\",\"ts\":%lld,\"pid\":0,\"tid\":%zu}", event.phase, (long long) event.ts, buffer->tid);
+                sep = ",\n";
+            }
+        }
+        std::fprintf(file, "\n]}\n");
+        std::fclose(file);
+    }
+
+    std::chrono::steady_clock::time_point start;
+    std::mutex mutex;
+    std::atomic<bool> done { false };
+    // buffers stay alive until the trace is written - threads may exit earlier
+    std::vector<std::unique_ptr<Buffer>> buffers;
+};
+
+// never destroyed - threads which outlive exit may still call record
+Trace& trace() {
+    static Trace* trace = [] {
+        auto trace = new Trace();
+        std::atexit([] { ::trace().write(); });
+        return trace;
+    }();
+    return *trace;
+}
+
+void record(uint32_t id, char phase) {
+    auto& t = trace();
+    if (t.done.load(std::memory_order_relaxed))
+        return;
+
+    thread_local Buffer* buffer = nullptr;
+    if (buffer == nullptr) {
+        std::lock_guard<std::mutex> guard(t.mutex);
+        t.buffers.emplace_back(new Buffer());
+        buffer = t.buffers.back().get();
+        buffer->tid = t.buffers.size() - 1;
+    }
+
+    auto ts = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t.start).count();
+    std::lock_guard<std::mutex> guard(buffer->mutex);
+    // write sets done before it locks the buffers
+    if (!t.done)
+        buffer->events.push_back({id, phase, ts});
+}
+
+}
+
+extern "C" void __impala_trace_enter(uint32_t id) { record(id, 'B'); }
+extern "C" void __impala_trace_exit(uint32_t id) { record(id, 'E'); }
@@ -0,0 +1,217 @@
+#!/usr/bin/env python3
+
+# Times the executables generated for the benchmarks in codegen/benchmarks.
+# Each benchmark is built for every combination of optimization level, -Othorin and backend,
+# run --repeat times per problem size and summarized; results are stored as JSON and may be
+# compared against an earlier run via --compare.
+
+import json
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+from perform import EXE, search_in_path
+
+
+BENCHMARK_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'codegen', 'benchmarks')
+
+
+class Benchmark(object):
+    def __init__(self, filename):
+        self.filename = filename
+        self.name = os.path.splitext(os.path.basename(filename))[0]
+        self.link_flags = []
+        self.sizes = []
+        with open(filename) as file:
+            tokens = file.readline().split()
+        for token in tokens[2:] if tokens[:2] == ['//', 'codegen'] else []:
+            if token.startswith('-l'):
+                self.link_flags.append(token)
+            elif token.startswith('"'):
+                self.sizes.append(token.strip('"'))
+        stdin = os.path.splitext(filename)[0] + '.in'
+        self.stdin = stdin if os.path.isfile(stdin) else None
+
+
+class Config(object):
+    def __init__(self, opt, thorin, backend):
+        self.opt = opt
+        self.thorin = thorin
+        self.backend = backend
+
+    def name(self):
+        return '{}{}-{}'.format(self.opt, '-Othorin' if self.thorin else '', self.backend)
+
+
+def build(args, benchmark, config, tempdir):
+    base = os.path.join(tempdir, benchmark.name + '-' + config.name())
+    flags = [config.opt, '-emit-llvm' if config.backend == 'llvm' else '-emit-c']
+    # -emit-llvm and -emit-c imply -Othorin
+    flags.append('-Othorin' if config.thorin else '-Onothorin')
+    start = time.perf_counter()
+    result = subprocess.run([args.impala] + flags + ['-o', base, benchmark.filename], stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    compile_time = time.perf_counter() - start
+    if result.returncode != 0:
+        print(result.stdout.decode('utf-8', 'ignore'))
+        return None, compile_time
+
+    source = base + ('.ll' if config.backend == 'llvm' else '.c')
+    clang = [args.clang, config.opt, '-x', 'c' if config.backend == 'c' else 'ir', source, '-x', 'c++', args.rtmock, '-o', base + EXE]
+    result = subprocess.run(clang + benchmark.link_flags, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    if result.returncode != 0:
+        print(result.stdout.decode('utf-8', 'ignore'))
+        return None, compile_time
+    return base + EXE, compile_time
+
+
+def run(args, benchmark, executable, size, timings):
+    stdin = open(benchmark.stdin, 'rb') if benchmark.stdin else None
+    env = dict(os.environ, IMPALA_TIMING_FILE=timings)
+    start = time.perf_counter()
+    result = subprocess.run([executable] + ([size] if size else []), stdin=stdin, stdout=subprocess.DEVNULL, env=env, timeout=args.run_timeout)
+    elapsed = time.perf_counter() - start
+    if stdin:
+        stdin.close()
+    return elapsed if result.returncode == 0 else None
+
+
+def read_timings(filename):
+    # lines '<name> <microseconds>' written by impala_timer_stop in rtmock.cpp
+    timings = {}
+    if os.path.isfile(filename):
+        with open(filename) as file:
+            for line in file:
+                name, usec = line.rsplit(None, 1)
+                timings.setdefault(name, []).append(int(usec) / 1e6)
+        os.remove(filename)
+    return timings
+
+
+def summarize(samples):
+    return {
+        'min': min(samples),
+        'median': statistics.median(samples),
+        'mean': statistics.mean(samples),
+        'stdev': statistics.stdev(samples) if len(samples) > 1 else 0.0,
+        'samples': samples,
+    }
+
+
+def compare(results, baseline, threshold):
+    old = {(r['benchmark'], r['config'], r['size']): r for r in baseline['results']}
+    regressions = []
+    for r in results:
+        b = old.get((r['benchmark'], r['config'], r['size']))
+        if b is None or 'time' not in r or 'time' not in b:
+            continue
+        ratio = r['time']['median'] / b['time']['median'] if b['time']['median'] > 0 else 1.0
+        marker = ''
+        if ratio > 1.0 + threshold:
+            marker = ' <- slower'
+            regressions.append(r)
+        elif ratio < 1.0 - threshold:
+            marker = ' <- faster'
+        print('{:12} {:24} {:>10} {:8.3f}s -> {:8.3f}s ({:+.1%}){}'.format(
+            r['benchmark'], r['config'], r['size'], b['time']['median'], r['time']['median'], ratio - 1.0, marker))
+    return regressions
+
+
+def git_revision():
+    try:
+        return subprocess.run(['git', 'rev-parse', 'HEAD'], stdout=subprocess.PIPE, stderr=subprocess.DEVNULL,
+                              cwd=os.path.dirname(os.path.abspath(__file__))).stdout.decode().strip()
+    except OSError:
+        return ''
+
+
+if __name__ == '__main__':
+    import argparse
+
+    config = {'IMPALA_BIN': None, 'CLANG_BIN': None, 'LIBRTMOCK': None}
+    try:
+        import configRelease as config
+    except ImportError as e:
+        try:
+            import configDebug as config
+        except ImportError as e:
+            pass
+    get = lambda key: getattr(config, key, None) if not isinstance(config, dict) else config[key]
+
+    parser = argparse.ArgumentParser(formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+    parser.add_argument('benchmark',          nargs='*', help='benchmarks to run; all in codegen/benchmarks if omitted', type=str)
+    parser.add_argument('-i', '--impala',     help='path to impala',                           type=str, default=get('IMPALA_BIN'))
+    parser.add_argument('-c', '--clang',      help='path to clang',                            type=str, default=get('CLANG_BIN'))
+    parser.add_argument(      '--rtmock',     help='path to rtmock',                           type=str, default=get('LIBRTMOCK'))
+    parser.add_argument(      '--opt',        help='optimization levels',                      type=str, default=['O0', 'O1', 'O2', 'O3'], nargs='+')
+    parser.add_argument(      '--thorin',     help='build with and/or without -Othorin',       type=str, default=['on', 'off'], nargs='+', choices=['on', 'off'])
+    parser.add_argument('-b', '--backend',    help='backends',                                 type=str, default=['llvm', 'c'], nargs='+', choices=['llvm', 'c'])
+    parser.add_argument('-s', '--size',       help='problem sizes as <benchmark>=<n>[,<n>...]; defaults to the size in the test header', type=str, default=[], nargs='+')
+    parser.add_argument('-r', '--repeat',     help='runs per benchmark, configuration and size', type=int, default=5)
+    parser.add_argument(      '--run-timeout', help='timeout for a single run',                type=int, default=300)
+    parser.add_argument('-o', '--output',     help='file receiving the results',               type=str, default='bench-results.json')
+    parser.add_argument(      '--compare',    help='results of an earlier run to compare against', type=str, default=None)
+    parser.add_argument(      '--threshold',  help='relative change reported as regression',   type=float, default=0.05)
+    args = parser.parse_args()
+
+    if args.impala is None:
+        args.impala = search_in_path('impala')
+    if args.clang is None:
+        args.clang = search_in_path('clang')
+    if args.impala is None or args.clang is None or args.rtmock is None:
+        print('Unable to determine the paths to impala, clang and rtmock')
+        sys.exit(2)
+
+    names = args.benchmark or sorted(os.path.splitext(f)[0] for f in os.listdir(BENCHMARK_DIR) if f.endswith('.impala'))
+    benchmarks = [Benchmark(os.path.join(BENCHMARK_DIR, name + '.impala')) for name in names]
+
+    sizes = {}
+    for size in args.size:
+        name, values = size.split('=', 1)
+        sizes[name] = values.split(',')
+
+    configs = [Config('-' + opt.lstrip('-'), thorin == 'on', backend) for backend in args.backend for opt in args.opt for thorin in args.thorin]
+
+    results = []
+    with tempfile.TemporaryDirectory() as tempdir:
+        timings = os.path.join(tempdir, 'timings')
+        for benchmark in benchmarks:
+            for config in configs:
+                executable, compile_time = build(args, benchmark, config, tempdir)
+                for size in sizes.get(benchmark.name, benchmark.sizes or ['']):
+                    result = {'benchmark': benchmark.name, 'config': config.name(), 'size': size, 'compile_time': compile_time}
+                    if executable is None:
+                        result['error'] = 'build failed'
+                        results.append(result)
+                        continue
+
+                    samples = []
+                    for _ in range(args.repeat):
+                        elapsed = run(args, benchmark, executable, size, timings)
+                        if elapsed is None:
+                            result['error'] = 'run failed'
+                            break
+                        samples.append(elapsed)
+                    if samples:
+                        result['time'] = summarize(samples)
+                    kernels = read_timings(timings)
+                    if kernels:
+                        result['kernels'] = {name: summarize(s) for name, s in kernels.items()}
+                    results.append(result)
+
+                    status = result.get('error') or '{:.3f}s median'.format(result['time']['median'])
+                    print('{:12} {:24} {:>10} {}'.format(benchmark.name, config.name(), size, status))
+
+    report = {'revision': git_revision(), 'date': time.strftime('%Y-%m-%dT%H:%M:%S'), 'repeat': args.repeat, 'results': results}
+    with open(args.output, 'w') as file:
+        json.dump(report, file, indent=2)
+
+    failed = any('error' in r for r in results)
+    if args.compare:
+        with open(args.compare) as file:
+            if compare(results, json.load(file), args.threshold):
+                failed = True
+
+    sys.exit(1 if failed else 0)
@@ -1,5 +1,6 @@
 #!/usr/bin/env python3
 
+import glob
 import os
 import subprocess
 import sys
@@ -16,12 +17,13 @@ class TestMethod(object):
         self.stdin = None
         self.stdout = None
         self.returncode = None
+        self.env = None
 
     def __call__(self, args, input=None):
         # print(args)
         self.stdin = input
         try:
-            self.completed = subprocess.run([self.executable] + args, timeout=self.timeout, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, stdin=self.stdin)
+            self.completed = subprocess.run([self.executable] + args, timeout=self.timeout, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, stdin=self.stdin, env=self.env)
             self.stdout = self.completed.stdout
             self.returncode = self.completed.returncode
         except subprocess.TimeoutExpired as e:
@@ -62,12 +64,19 @@ class TestMethod(object):
 
 
 class RunImpalaCompile(TestMethod):
-    def __init__(self, impala, add_flags=[], timeout=None):
+    def __init__(self, impala, add_flags=[], timeout=None, emit='llvm', profile=None):
         super().__init__(impala, timeout=timeout)
         self.flags = add_flags
+        self.emit = emit
+        self.profile = profile
 
     def __call__(self, testfile, addflags):
-        super().__call__(["-emit-llvm", "-O2", "-o", testfile.intermediate(), testfile.filename()] + self.flags)
+        imports = ["-I", testfile.intermediate('.modules')] if testfile.modules() else []
+        if self.profile == 'generate':
+            imports += ["-fprofile-generate"]
+        elif self.profile == 'use':
+            imports += ["-fprofile-use", testfile.intermediate('.profdata')]
+        super().__call__(["-emit-" + self.emit, "-O2"] + imports + ["-o", testfile.intermediate(), testfile.filename()] + self.flags)
 
         self.dump_output(testfile.intermediate('.log'))
 
@@ -86,15 +95,41 @@ class RunImpalaCompile(TestMethod):
 
         return True
 
+class CompileModuleInterfaces(TestMethod):
+    def __init__(self, impala, add_flags=[], timeout=None, emit='llvm'):
+        super().__init__(impala, timeout=timeout)
+        self.flags = add_flags
+        self.emit = emit
+
+    def __call__(self, testfile, addflags):
+        if not os.path.isdir(testfile.intermediate('.modules')):
+            os.makedirs(testfile.intermediate('.modules'))
+
+        for module in testfile.modules():
+            super().__call__(["-emit-interface", "-emit-" + self.emit, "-O2", "-o", testfile.module(module), testfile.module_source(module)] + self.flags)
+
+            self.dump_output(testfile.module(module, '.log'))
+
+            if self.wrong_returncode():
+                print("Compiling module", module, "failed")
+                return False
+
+        return True
+
 class LinkFakeRuntime(TestMethod):
-    def __init__(self, clang, runtime, add_flags=[]):
+    def __init__(self, clang, runtime, add_flags=[], ext='.ll', profile_rt=None):
         super().__init__(clang)
         self.runtime = runtime
         self.flags = add_flags
+        self.ext = ext
+        self.profile_rt = profile_rt
 
     def __call__(self, testfile, addflags):
         flags = self.flags + [flag for flag in addflags if flag.startswith('-l')]
-        super().__call__([testfile.intermediate('.ll'), LIBC, self.runtime, "-o", testfile.intermediate(EXE)] + flags)
+        if self.profile_rt is not None:
+            flags += [self.profile_rt, "-lstdc++", "-pthread"]
+        modules = [testfile.module(module, self.ext) for module in testfile.modules()]
+        super().__call__([testfile.intermediate(self.ext)] + modules + [LIBC, self.runtime, "-o", testfile.intermediate(EXE)] + flags)
 
         self.dump_output(None)
 
@@ -105,8 +140,9 @@ class LinkFakeRuntime(TestMethod):
         return True
 
 class ExecuteTestOutput(TestMethod):
-    def __init__(self, timeout=None):
+    def __init__(self, timeout=None, profile=False):
         super().__init__(None, timeout=timeout)
+        self.profile = profile
 
     def loadinput(self, testfile):
         return self.load_source_file(testfile.source('.in'))
@@ -115,6 +151,8 @@ class ExecuteTestOutput(TestMethod):
         if not os.path.isfile(testfile.intermediate(EXE)):
             return False
         self.executable = testfile.intermediate(EXE)
+        if self.profile:
+            self.env = dict(os.environ, IMPALA_PROFILE_FILE=testfile.intermediate('.profdata'))
         stdin = self.loadinput(testfile)
         super().__call__([], input=stdin)
 
@@ -126,6 +164,17 @@ class ExecuteTestOutput(TestMethod):
 
         return True
 
+class CheckProfileHints(TestMethod):
+    def __init__(self):
+        super().__init__(None)
+
+    def __call__(self, testfile, addflags):
+        with open(testfile.intermediate('.ll'), 'r') as ll:
+            if 'llvm.expect.with.probability' not in ll.read():
+                print("Impala did not hint the profile of", testfile.filename(), "to LLVM")
+                return False
+        return True
+
 class MultiStepPipeline(object):
     def __init__(self, *args):
         self.steps = args
@@ -161,6 +210,17 @@ class TestFile(object):
     def intermediate(self, ext=''):
         return os.path.join(self.temp, self.dir, self.base + ext)
 
+    # modules imported via 'mod <name>;' live in a directory named after the test
+    def modules(self):
+        sources = glob.glob(os.path.join(self.dir, self.base, '*.impala'))
+        return sorted(os.path.splitext(os.path.basename(source))[0] for source in sources)
+
+    def module_source(self, module):
+        return os.path.join(self.dir, self.base, module + '.impala')
+
+    def module(self, module, ext=''):
+        return os.path.join(self.intermediate('.modules'), module + ext)
+
 
 def fetch_tokens(testfile, test_methods):
     firstline = testfile.readline()
@@ -219,8 +279,10 @@ if __name__ == '__main__':
     parser.add_argument('-c', '--clang',           help='path to clang',                      type=str, default=config.CLANG_BIN)
     parser.add_argument(      '--impala-flag',     help='additional flag(s) for impala',      type=str, default='')
     parser.add_argument(      '--clang-flag',      help='additional flag(s) for clang',       type=str, default='')
+    parser.add_argument(      '--emit',            help='compile to textual llvm or to an object file', choices=['llvm', 'obj'], default='llvm')
     parser.add_argument(      '--temp',            help='path to temp dir',                   type=str, default=config.TEMP_DIR)
     parser.add_argument(      '--rtmock',          help='path to rtmock',                     type=str, default=config.LIBRTMOCK)
+    parser.add_argument(      '--profile-rt',      help='path to the profiling runtime',      type=str, default=None)
     parser.add_argument('-t', '--compile-timeout', help='timeout for compiling test case',    type=int, default=5)
     parser.add_argument('-r', '--run-timeout',     help='timeout for running test case',      type=int, default=5)
     parser.add_argument('--pedantic', '-p',        help='also run tests that are known to be broken or do not provide a valid testing procedure', action='store_true')
@@ -245,7 +307,23 @@ if __name__ == '__main__':
 
     test_methods = {
         'codegen' : MultiStepPipeline(
-            RunImpalaCompile(args.impala, impala_flags, timeout=args.compile_timeout),
+            RunImpalaCompile(args.impala, impala_flags, timeout=args.compile_timeout, emit=args.emit),
+            LinkFakeRuntime(args.clang, args.rtmock, clang_flags, ext='.ll' if args.emit == 'llvm' else '.o'),
+            ExecuteTestOutput(timeout=args.run_timeout)
+        ),
+        'interface' : MultiStepPipeline(
+            CompileModuleInterfaces(args.impala, impala_flags, timeout=args.compile_timeout, emit=args.emit),
+            RunImpalaCompile(args.impala, impala_flags, timeout=args.compile_timeout, emit=args.emit),
+            LinkFakeRuntime(args.clang, args.rtmock, clang_flags, ext='.ll' if args.emit == 'llvm' else '.o'),
+            ExecuteTestOutput(timeout=args.run_timeout)
+        ),
+        # runs an instrumented build to collect a profile, then checks that the build using it carries the hints
+        'profile' : MultiStepPipeline(
+            RunImpalaCompile(args.impala, impala_flags, timeout=args.compile_timeout, profile='generate'),
+            LinkFakeRuntime(args.clang, args.rtmock, clang_flags, profile_rt=args.profile_rt),
+            ExecuteTestOutput(timeout=args.run_timeout, profile=True),
+            RunImpalaCompile(args.impala, impala_flags, timeout=args.compile_timeout, profile='use'),
+            CheckProfileHints(),
             LinkFakeRuntime(args.clang, args.rtmock, clang_flags),
             ExecuteTestOutput(timeout=args.run_timeout)
         )
@@ -273,6 +351,10 @@ if __name__ == '__main__':
             print(action, "test", filename, "-", "Unknown testing procedure!")
             return outcome
 
+        if method is test_methods['profile'] and args.profile_rt is None:
+            print(action, "test", filename, "-", "The path to the profiling runtime is unknown.")
+            return outcome
+
         return method(file, addflags)
 
     result = None
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <chrono>
 #include <cstring>
 
 #ifdef __cplusplus
@@ -40,6 +41,19 @@ void put_u8(unsigned char ui) {
    putc(ui, stdout);
 }
 
+// implements 'fn mirror_big(Big, f32) -> Big' of an extern block without ABI:
+// large structs are passed and returned through pointers like in headers from -emit-c-interface
+struct Big {
+    float a[8];
+    int32_t n;
+};
+
+void mirror_big(struct Big* _result, const struct Big* b, float k) {
+    for (int i = 0; i < 8; ++i)
+        _result->a[i] = b->a[7 - i] * k;
+    _result->n = b->n + 1;
+}
+
 #if _POSIX_VERSION >= 200112L || _XOPEN_SOURCE >= 600
 void* anydsl_aligned_malloc(size_t size, size_t alignment) {
     void* p = nullptr;
@@ -134,6 +148,28 @@ int forty_two() {
     return 42;
 }
 
+// timing hooks for benchmarks - each stop appends '<name> <microseconds>' to $IMPALA_TIMING_FILE if set
+long long anydsl_get_micro_time() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static long long timer_start;
+
+void impala_timer_start() {
+    timer_start = anydsl_get_micro_time();
+}
+
+void impala_timer_stop(const char* name) {
+    long long elapsed = anydsl_get_micro_time() - timer_start;
+    if (const char* file_name = getenv("IMPALA_TIMING_FILE")) {
+        if (FILE* file = fopen(file_name, "a")) {
+            fprintf(file, "%s %lld\n", name, elapsed);
+            fclose(file);
+        }
+    }
+}
+
 int32_t anydsl_atoi(char* str) { return atoi(str); }
 void anydsl_memset(char* s, int32_t c, uint64_t n) { memset(s, c, n); }
 